@@ -26,6 +26,7 @@
 #include <netdb.h>
 
 #include "mysock.h"
+#include "mysock_opts.h"
 
 
 
@@ -36,7 +37,8 @@
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
 #endif
 
-static char usage[] = "usage: client [-U] [-q] [-f <filename>] server:port\n";
+static char usage[] = "usage: client [-U] [-q] " MYSOCK_OPTS_USAGE
+                      " [-f <filename>] server:port\n";
 static char *filename;
 static int quiet_opt = 0;
 
@@ -55,12 +57,14 @@ main(int argc, char *argv[])
     char reliable = 1;
     int errflg = 0;
     int sd;
+    mysock_opts_t sockopts;
 
 
 
     filename = NULL;
+    mysock_opts_init(&sockopts);
     /* Parse command line options */
-    while ((opt = getopt(argc, argv, "f:qU")) != EOF)
+    while ((opt = getopt(argc, argv, "f:qU" MYSOCK_OPTS_GETOPT)) != EOF)
     {
         switch (opt)
         {
@@ -78,6 +82,11 @@ main(int argc, char *argv[])
         case '?':
             ++errflg;
             break;
+
+        default:
+            if (mysock_opts_parse(&sockopts, opt, optarg) < 0)
+                ++errflg;
+            break;
         }
     }
 
@@ -107,6 +116,12 @@ main(int argc, char *argv[])
         exit(1);
     }
 
+    if (mysock_opts_apply(&sockopts, sd) < 0)
+    {
+        perror("mysetsockopt");
+        exit(1);
+    }
+
     sd = myconnect(sd, (struct sockaddr *) &sin, sizeof(struct sockaddr_in));
     if (sd < 0)
     {
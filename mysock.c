@@ -10,6 +10,7 @@
 #include "mysock.h"
 #include "mysock_impl.h"
 #include "network_io.h"
+#include "network.h"
 #include "stcp_api.h"
 #include "transport.h"
 
@@ -34,6 +35,28 @@ static bool_t _mysock_free_queue(mysock_context_t *ctx, packet_queue_t *pq);
 /* mysocket descriptor table, one entry per STCP connection */
 static mysock_context_t *global_ctx[MAX_NUM_CONNECTIONS];
 
+/* initial values of the mysocket options, indexed by MYSO_* */
+static const int default_options[MYSO_NUM_OPTIONS] =
+{
+    MYCC_NEWRENO,   /* MYSO_CONGESTION */
+    TRUE,           /* MYSO_SACK */
+    TRUE,           /* MYSO_WINDOW_SCALE */
+    TRUE,           /* MYSO_TIMESTAMPS */
+    TRUE,           /* MYSO_DELAYED_ACK */
+    FALSE,          /* MYSO_NODELAY */
+    FALSE,          /* MYSO_CORK */
+    MAX_IP_PAYLOAD_LEN, /* MYSO_MTU */
+    256 * 1024,     /* MYSO_SNDBUF */
+    1024 * 1024,    /* MYSO_RCVBUF */
+    0,              /* MYSO_FEC */
+    TRUE,           /* MYSO_PACING */
+    0,              /* MYSO_MAX_PACING_RATE */
+    TRUE,           /* MYSO_ECN */
+    0,              /* MYSO_LINK_RATE */
+    TRUE,           /* MYSO_METRICS */
+    FALSE           /* MYSO_CONGESTION_MANAGER */
+};
+
 
 /* create a new mysocket, and find space in our mysocket descriptor table */
 mysocket_t _mysock_new_mysocket(bool_t is_reliable)
@@ -119,6 +142,94 @@ int _mysock_wait_for_connection(mysock_context_t *ctx)
     return (errno = ctx->stcp_errno) ? -1 : 0;
 }
 
+/* ask the transport layer to send everything the application has written
+ * so far, without waiting to fill a segment.  the transport layer hears
+ * about it through stcp_wait_for_event().
+ */
+void _mysock_request_flush(mysock_context_t *ctx)
+{
+    assert(ctx);
+
+    PTHREAD_CALL(pthread_mutex_lock(&ctx->data_ready_lock));
+    ctx->flush_requested = TRUE;
+    PTHREAD_CALL(pthread_mutex_unlock(&ctx->data_ready_lock));
+    PTHREAD_CALL(pthread_cond_broadcast(&ctx->data_ready_cond));
+}
+
+/* tell the transport layer that the application has read some of the data
+ * passed up to it, so there may be room to open the receive window.  this
+ * also arrives through stcp_wait_for_event().  the transport layer only
+ * clears the flag when it's waiting for the event, so while the app keeps
+ * up, it isn't woken on every read.
+ */
+void _mysock_notify_read(mysock_context_t *ctx)
+{
+    bool_t was_read;
+
+    assert(ctx);
+
+    PTHREAD_CALL(pthread_mutex_lock(&ctx->data_ready_lock));
+    was_read = ctx->data_read;
+    ctx->data_read = TRUE;
+    PTHREAD_CALL(pthread_mutex_unlock(&ctx->data_ready_lock));
+    if (!was_read)
+        PTHREAD_CALL(pthread_cond_broadcast(&ctx->data_ready_cond));
+}
+
+/* block until the application may queue more data for the transport layer
+ * with mywrite(), i.e. until the data already queued is under MYSO_SNDBUF
+ * (once it's reached the limit, until it's down to half).  returns the
+ * number of bytes that may be queued, or 0 if the transport layer has
+ * finished and will take no more.
+ */
+size_t _mysock_wait_for_send_space(mysock_context_t *ctx)
+{
+    size_t limit, room = 0;
+
+    assert(ctx);
+
+    PTHREAD_CALL(pthread_mutex_lock(&ctx->data_ready_lock));
+    while (!ctx->transport_done)
+    {
+        limit = (size_t) ctx->options[MYSO_SNDBUF];
+        if (ctx->app_recv_queue.len < limit && !ctx->send_space_wanted)
+        {
+            room = limit - ctx->app_recv_queue.len;
+            break;
+        }
+
+        ctx->send_space_wanted = TRUE;
+        PTHREAD_CALL(pthread_cond_wait(&ctx->data_ready_cond,
+                                       &ctx->data_ready_lock));
+    }
+    PTHREAD_CALL(pthread_mutex_unlock(&ctx->data_ready_lock));
+
+    return room;
+}
+
+/* the transport layer has taken some of the data queued by mywrite(), or
+ * the limit has changed; wake the application if it's waiting for room.
+ * it's only woken once the queue is down to half the limit, so that it
+ * refills it in large pieces rather than trading a wakeup for each one.
+ */
+void _mysock_notify_send_space(mysock_context_t *ctx)
+{
+    bool_t wake = FALSE;
+
+    assert(ctx);
+
+    PTHREAD_CALL(pthread_mutex_lock(&ctx->data_ready_lock));
+    if (ctx->send_space_wanted &&
+        ctx->app_recv_queue.len <= (size_t) ctx->options[MYSO_SNDBUF] / 2)
+    {
+        ctx->send_space_wanted = FALSE;
+        wake = TRUE;
+    }
+    PTHREAD_CALL(pthread_mutex_unlock(&ctx->data_ready_lock));
+    if (wake)
+        PTHREAD_CALL(pthread_cond_broadcast(&ctx->data_ready_cond));
+}
+
 
 /* add an incoming buffer (packet) to a queue for this connection; it will be
  * dequeued by stcp_network_recv() or myread() when the transport layer or
@@ -163,6 +274,7 @@ void _mysock_enqueue_buffer(mysock_context_t *ctx,
         pq->tail->next = node;
         pq->tail = node;
     }
+    pq->len += packet_len;
     PTHREAD_CALL(pthread_mutex_unlock(&ctx->data_ready_lock));
     PTHREAD_CALL(pthread_cond_broadcast(&ctx->data_ready_cond));
 }
@@ -201,6 +313,7 @@ size_t _mysock_dequeue_buffer(mysock_context_t *ctx,
         /* remove only a portion of the packet at the head of the queue,
          * leaving the rest around for the next call to dequeue_buffer().
          */
+        pq->len -= max_len;
         PTHREAD_CALL(pthread_mutex_unlock(&ctx->data_ready_lock));
 
         memcpy(dst, node->data, max_len);
@@ -216,6 +329,7 @@ size_t _mysock_dequeue_buffer(mysock_context_t *ctx,
             assert(pq->tail == node);
             pq->tail = NULL;
         }
+        pq->len -= node->data_len;
         PTHREAD_CALL(pthread_mutex_unlock(&ctx->data_ready_lock));
 
         memcpy(dst, node->data, MIN(max_len, node->data_len));
@@ -265,6 +379,7 @@ static bool_t _mysock_free_queue(mysock_context_t *ctx, packet_queue_t *pq)
 static mysock_context_t *_mysock_allocate_context(void)
 {
     mysock_context_t *ctx = 0;
+    pthread_condattr_t cond_attr;
 
     ctx = (mysock_context_t *) calloc(1, sizeof(mysock_context_t));
     assert(ctx);
@@ -272,6 +387,9 @@ static mysock_context_t *_mysock_allocate_context(void)
     /* by default, sockets are active */
     ctx->listen_sd = -1;
 
+    assert(sizeof(ctx->options) == sizeof(default_options));
+    memcpy(ctx->options, default_options, sizeof(ctx->options));
+
     /* initialise connection condition variable.  this is signaled when the
      * connection is established, i.e. myconnect() or myaccept() should
      * unblock and return to the calling application.
@@ -280,9 +398,13 @@ static mysock_context_t *_mysock_allocate_context(void)
     PTHREAD_CALL(pthread_mutex_init(&ctx->blocking_lock, NULL));
 
     /* initialise data ready condition variable.  this is signaled when
-     * data is ready from the application or the network.
+     * data is ready from the application or the network.  the transport
+     * layer's timeouts for it are on the monotonic clock.
      */
-    PTHREAD_CALL(pthread_cond_init(&ctx->data_ready_cond, NULL));
+    PTHREAD_CALL(pthread_condattr_init(&cond_attr));
+    PTHREAD_CALL(pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC));
+    PTHREAD_CALL(pthread_cond_init(&ctx->data_ready_cond, &cond_attr));
+    PTHREAD_CALL(pthread_condattr_destroy(&cond_attr));
     PTHREAD_CALL(pthread_mutex_init(&ctx->data_ready_lock, NULL));
 
     ctx->blocking = TRUE;   /* we unblock once we're connected */
@@ -326,6 +448,8 @@ void _mysock_free_context(mysock_context_t *ctx)
     (void) _mysock_free_queue(ctx, &ctx->app_recv_queue);
     (void) _mysock_free_queue(ctx, &ctx->app_send_queue);
 
+    _network_stop_link(ctx);
+    free(ctx->network_state.copy_buffer);
     _network_close(&ctx->network_state);
 
     /* clear mysocket descriptor table entry */
@@ -385,8 +509,14 @@ static void *transport_thread_func(void *arg_ptr)
         PTHREAD_CALL(pthread_mutex_unlock(&ctx->blocking_lock));
     }
 
+    /* nothing more will be taken from mywrite(); don't leave it waiting */
+    PTHREAD_CALL(pthread_mutex_lock(&ctx->data_ready_lock));
+    ctx->transport_done = TRUE;
+    PTHREAD_CALL(pthread_mutex_unlock(&ctx->data_ready_lock));
+
     /* force final myread() to return 0 bytes (this should have been done
-     * by the transport layer already in response to the peer's FIN).
+     * by the transport layer already in response to the peer's FIN).  this
+     * wakes mywrite() too.
      */
     _mysock_enqueue_buffer(ctx, &ctx->app_send_queue, &eof_packet, 0);
     return NULL;
@@ -35,6 +35,79 @@ typedef int mysocket_t;     /* mysocket descriptor */
 #endif
 
 
+/* mysocket options, set with mysetsockopt() and read with mygetsockopt().
+ * all option values are ints.  options are inherited by connections
+ * accepted on a listening mysocket, and take effect for connections
+ * established after they're set; MYSO_NODELAY, MYSO_CORK, MYSO_SNDBUF,
+ * MYSO_PACING, MYSO_MAX_PACING_RATE and MYSO_LINK_RATE also take effect
+ * immediately on an established connection.
+ */
+enum
+{
+    MYSO_CONGESTION,        /* congestion control algorithm (MYCC_*) */
+    MYSO_SACK,              /* nonzero to use selective acks (RFC 2018) */
+    MYSO_WINDOW_SCALE,      /* nonzero to allow windows over 64KB (RFC 7323) */
+    MYSO_TIMESTAMPS,        /* nonzero to timestamp segments (RFC 7323) */
+    MYSO_DELAYED_ACK,       /* nonzero to delay and coalesce ACKs */
+    MYSO_NODELAY,           /* nonzero to disable Nagle's algorithm */
+    MYSO_CORK,              /* nonzero to send only full-sized segments */
+    MYSO_MTU,               /* largest packet to exchange with the peer */
+    MYSO_SNDBUF,            /* most bytes mywrite() queues before blocking */
+    MYSO_RCVBUF,            /* largest the receive window may grow to */
+    MYSO_FEC,               /* data segments per parity segment, or 0 */
+    MYSO_PACING,            /* nonzero to pace segments at cwnd over the RTT */
+    MYSO_MAX_PACING_RATE,   /* most bytes/s to send at, or 0 for no cap */
+    MYSO_ECN,               /* nonzero to use congestion marks (RFC 3168) */
+    MYSO_LINK_RATE,         /* bytes/s of the emulated link, or 0 for none */
+    MYSO_METRICS,           /* nonzero to start from what earlier connections
+                             * to the same host learnt about the path */
+    MYSO_CONGESTION_MANAGER,    /* nonzero to share one congestion window
+                                 * with other connections to the host */
+    MYSO_NUM_OPTIONS
+};
+
+/* limits on MYSO_MTU, which counts the STCP header and options as well as
+ * data.  the network layer frames each packet with a 16-bit length.
+ */
+#define MYSO_MTU_MIN    256
+#define MYSO_MTU_MAX    65535
+
+/* lower limit on MYSO_SNDBUF.  this counts only data the transport layer
+ * hasn't taken yet; it holds unacknowledged data separately.
+ */
+#define MYSO_SNDBUF_MIN 1024
+
+/* lower limit on MYSO_RCVBUF.  the window starts smaller than this ceiling
+ * and grows towards it as the transfer rate demands; the transport layer
+ * may also cap it at what it can hold.
+ */
+#define MYSO_RCVBUF_MIN 1024
+
+/* limits on MYSO_FEC, other than 0 (no parity sent).  the peer needn't
+ * set it to rebuild data from the parity; any STCP peer can.
+ */
+#define MYSO_FEC_MIN    2
+#define MYSO_FEC_MAX    16
+
+/* MYSO_LINK_RATE puts an emulated bottleneck in the way of the packets
+ * this mysocket sends, with a queue that drains at the given rate.  once
+ * the queue holds a few milliseconds' worth, packets that the transport
+ * marked ECN-capable are marked "congestion experienced", and others are
+ * dropped; a much longer queue drops everything.  nothing is ever dropped
+ * on a reliable mysocket, though, only marked.
+ */
+
+/* congestion control algorithms (MYSO_CONGESTION) */
+enum
+{
+    MYCC_RENO,
+    MYCC_NEWRENO,
+    MYCC_CUBIC,
+    MYCC_BBR,
+    MYCC_NUM_ALGORITHMS
+};
+
+
 extern mysocket_t mysocket(bool_t is_reliable);
 extern int mybind(mysocket_t sd, struct sockaddr *addr, int addrlen);
 extern int mylisten(mysocket_t sd, int backlog);
@@ -43,10 +116,15 @@ extern int myaccept(mysocket_t sd, struct sockaddr* addr, int *addrlen);
 extern int myclose(mysocket_t sd);
 extern int myread(mysocket_t sd, void *buffer, size_t length);
 extern int mywrite(mysocket_t sd, const void *buffer, size_t length);
+extern int myflush(mysocket_t sd);
 extern int mygetsockname(mysocket_t sd, struct sockaddr *addr,
                          socklen_t *addrlen);
 extern int mygetpeername(mysocket_t sd, struct sockaddr *addr,
                          socklen_t *addrlen);
+extern int mysetsockopt(mysocket_t sd, int optname,
+                        const void *optval, socklen_t optlen);
+extern int mygetsockopt(mysocket_t sd, int optname,
+                        void *optval, socklen_t *optlen);
 
 /* return IP address of interface on which packets to/from peer_addr are
  * delivered.  peer_addr is in network byte order.
@@ -195,18 +195,49 @@ int myclose(mysocket_t sd)
     return 0;
 }
 
+/* queue data for the transport layer to send.  at most MYSO_SNDBUF bytes
+ * are held at a time; beyond that, the call blocks until the transport
+ * layer takes some.  like write() on a blocking socket, it returns once
+ * everything is queued, or with a short count if the connection ends
+ * first (or -1 and EPIPE if nothing could be queued).
+ */
 int mywrite(mysocket_t sd, const void *buf, size_t buf_len)
 {
     mysock_context_t *ctx = _mysock_get_context(sd);
+    size_t written = 0, room, len;
 
     MYSOCK_CHECK(ctx != NULL, EBADF);
     MYSOCK_CHECK(!ctx->listening, EINVAL);
 
     assert(!ctx->close_requested);
-    _mysock_enqueue_buffer(ctx, &ctx->app_recv_queue, buf, buf_len);
+    while (written < buf_len)
+    {
+        if ((room = _mysock_wait_for_send_space(ctx)) == 0)
+            break;
+
+        len = MIN(room, buf_len - written);
+        _mysock_enqueue_buffer(ctx, &ctx->app_recv_queue,
+                               (const char *) buf + written, len);
+        written += len;
+    }
 
-    /* XXX: all bytes are queued, irrespective of current sender window */
-    return buf_len;
+    MYSOCK_CHECK(written > 0 || buf_len == 0, EPIPE);
+    return written;
+}
+
+/* send everything written so far on the given mysocket straight away,
+ * even if it doesn't fill a segment, and even if the mysocket is corked
+ * (MYSO_CORK) or holding small segments back (see MYSO_NODELAY).
+ */
+int myflush(mysocket_t sd)
+{
+    mysock_context_t *ctx = _mysock_get_context(sd);
+
+    MYSOCK_CHECK(ctx != NULL, EBADF);
+    MYSOCK_CHECK(!ctx->listening, EINVAL);
+
+    _mysock_request_flush(ctx);
+    return 0;
 }
 
 int myread(mysocket_t sd, void *buf, size_t buf_len)
@@ -228,6 +259,11 @@ int myread(mysocket_t sd, void *buf, size_t buf_len)
         /* make sure repeated calls to myread() return 0 on EOF */
         ctx->eof = TRUE;
     }
+    else
+    {
+        /* the transport layer may want to open the receive window */
+        _mysock_notify_read(ctx);
+    }
 
     return len;
 }
@@ -279,6 +315,85 @@ int mygetpeername(mysocket_t sd, struct sockaddr *name, socklen_t *namelen)
     return 0;
 }
 
+/* set a mysocket option (see MYSO_* in mysock.h).  like is_reliable, options
+ * set on a listening mysocket are passed down to the connections it
+ * accepts.
+ */
+int mysetsockopt(mysocket_t sd, int optname,
+                 const void *optval, socklen_t optlen)
+{
+    mysock_context_t *ctx = _mysock_get_context(sd);
+    int value;
+
+    MYSOCK_CHECK(ctx != NULL, EBADF);
+    MYSOCK_CHECK(optval != NULL && optlen == sizeof(int), EINVAL);
+    MYSOCK_CHECK(optname >= 0 && optname < MYSO_NUM_OPTIONS, ENOPROTOOPT);
+
+    value = *(const int *) optval;
+    switch (optname)
+    {
+    case MYSO_CONGESTION:
+        MYSOCK_CHECK(value >= 0 && value < MYCC_NUM_ALGORITHMS, EINVAL);
+        break;
+
+    case MYSO_MTU:
+        MYSOCK_CHECK(value >= MYSO_MTU_MIN && value <= MYSO_MTU_MAX, EINVAL);
+        break;
+
+    case MYSO_SNDBUF:
+        MYSOCK_CHECK(value >= MYSO_SNDBUF_MIN, EINVAL);
+        break;
+
+    case MYSO_RCVBUF:
+        MYSOCK_CHECK(value >= MYSO_RCVBUF_MIN, EINVAL);
+        break;
+
+    case MYSO_FEC:
+        MYSOCK_CHECK(value == 0 ||
+                     (value >= MYSO_FEC_MIN && value <= MYSO_FEC_MAX), EINVAL);
+        break;
+
+    case MYSO_MAX_PACING_RATE:
+    case MYSO_LINK_RATE:
+        MYSOCK_CHECK(value >= 0, EINVAL);
+        break;
+
+    default:
+        break;
+    }
+
+    ctx->options[optname] = value;
+
+    /* removing the cork, or turning off Nagle's algorithm, sends anything
+     * that was being held back.
+     */
+    if (!ctx->listening &&
+        ((optname == MYSO_CORK && !value) ||
+         (optname == MYSO_NODELAY && value)))
+    {
+        _mysock_request_flush(ctx);
+    }
+
+    /* a bigger send buffer may let a blocked mywrite() carry on */
+    if (!ctx->listening && optname == MYSO_SNDBUF)
+        _mysock_notify_send_space(ctx);
+    return 0;
+}
+
+int mygetsockopt(mysocket_t sd, int optname, void *optval, socklen_t *optlen)
+{
+    mysock_context_t *ctx = _mysock_get_context(sd);
+
+    MYSOCK_CHECK(ctx != NULL, EBADF);
+    MYSOCK_CHECK(optval != NULL && optlen != NULL, EFAULT);
+    MYSOCK_CHECK(*optlen >= sizeof(int), EINVAL);
+    MYSOCK_CHECK(optname >= 0 && optname < MYSO_NUM_OPTIONS, ENOPROTOOPT);
+
+    *(int *) optval = ctx->options[optname];
+    *optlen = sizeof(int);
+    return 0;
+}
+
 /* returns IP address of interface on which packets to/from network address
  * peer_addr (network byte order) are delivered.
  */
@@ -60,6 +60,7 @@ typedef struct
 {
     packet_queue_node_t *head;
     packet_queue_node_t *tail;
+    size_t               len;   /* total bytes queued */
 } packet_queue_t;
 
 /* mysocket context (and the arguments provided to the transport layer
@@ -71,6 +72,7 @@ typedef struct mysock_context
 {
     /* connection parameters */
     int is_active;      /* true if we're connect()ing, false if accept()ing */
+    int options[MYSO_NUM_OPTIONS];  /* set via mysetsockopt() */
 
     /* student's STCP implementation working state */
     void *stcp_state;
@@ -102,6 +104,10 @@ typedef struct mysock_context
     pthread_cond_t  data_ready_cond;
     pthread_mutex_t data_ready_lock;
     bool_t          close_requested;    /* myclose() called by app? */
+    bool_t          flush_requested;    /* myflush() or uncork by app? */
+    bool_t          data_read;          /* app has myread() some data? */
+    bool_t          send_space_wanted;  /* mywrite() waiting for room? */
+    bool_t          transport_done;     /* transport thread finished? */
     bool_t          eof;                /* true once peer finishes writing */
 
     /* data sent to peer is sent immediately, so no queue is needed for that
@@ -124,6 +130,14 @@ void _mysock_transport_init(mysocket_t sd, bool_t is_active);
 
 int _mysock_wait_for_connection(mysock_context_t *ctx);
 
+void _mysock_request_flush(mysock_context_t *ctx);
+
+void _mysock_notify_read(mysock_context_t *ctx);
+
+size_t _mysock_wait_for_send_space(mysock_context_t *ctx);
+
+void _mysock_notify_send_space(mysock_context_t *ctx);
+
 void _mysock_free_context(mysock_context_t *ctx);
 
 void _mysock_enqueue_buffer(mysock_context_t *ctx,
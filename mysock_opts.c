@@ -0,0 +1,112 @@
+/* mysock_opts.c--command-line options for mysocket applications */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "mysock_opts.h"
+
+
+/* congestion control algorithms selectable with -c, indexed by MYCC_* */
+static const char *cc_names[MYCC_NUM_ALGORITHMS] =
+{
+    "reno", "newreno", "cubic", "bbr"
+};
+
+
+void mysock_opts_init(mysock_opts_t *opts)
+{
+    assert(opts);
+
+    opts->cc = -1;
+    opts->mtu = -1;
+    opts->fec = -1;
+    opts->rate = -1;
+    opts->share = -1;
+}
+
+/* opt is one of the letters in MYSOCK_OPTS_GETOPT, with argument arg.
+ * returns 0, or -1 if opt isn't one of ours or arg is out of range.
+ */
+int mysock_opts_parse(mysock_opts_t *opts, int opt, const char *arg)
+{
+    assert(opts);
+
+    switch (opt)
+    {
+    case 'c':
+        for (opts->cc = 0; opts->cc < MYCC_NUM_ALGORITHMS; ++opts->cc)
+        {
+            if (!strcmp(arg, cc_names[opts->cc]))
+                return 0;
+        }
+        break;
+
+    case 'm':
+        opts->mtu = atoi(arg);
+        if (opts->mtu >= MYSO_MTU_MIN && opts->mtu <= MYSO_MTU_MAX)
+            return 0;
+        break;
+
+    case 'e':
+        opts->fec = atoi(arg);
+        if (opts->fec >= MYSO_FEC_MIN && opts->fec <= MYSO_FEC_MAX)
+            return 0;
+        break;
+
+    case 'r':
+        opts->rate = atoi(arg);
+        if (opts->rate > 0)
+            return 0;
+        break;
+
+    case 'g':
+        opts->share = 1;
+        return 0;
+    }
+
+    return -1;
+}
+
+/* sets the options given on sd (a listening mysocket's are inherited by
+ * the connections it accepts).  returns 0, or -1 with errno set if one
+ * of them couldn't be set.
+ */
+int mysock_opts_apply(const mysock_opts_t *opts, mysocket_t sd)
+{
+    assert(opts);
+
+    if (opts->cc >= 0 &&
+        mysetsockopt(sd, MYSO_CONGESTION, &opts->cc, sizeof(opts->cc)) < 0)
+    {
+        return -1;
+    }
+
+    if (opts->mtu > 0 &&
+        mysetsockopt(sd, MYSO_MTU, &opts->mtu, sizeof(opts->mtu)) < 0)
+    {
+        return -1;
+    }
+
+    if (opts->fec > 0 &&
+        mysetsockopt(sd, MYSO_FEC, &opts->fec, sizeof(opts->fec)) < 0)
+    {
+        return -1;
+    }
+
+    if (opts->rate > 0 &&
+        mysetsockopt(sd, MYSO_LINK_RATE, &opts->rate, sizeof(opts->rate)) < 0)
+    {
+        return -1;
+    }
+
+    /* connections to the same host share a congestion window */
+    if (opts->share > 0 &&
+        mysetsockopt(sd, MYSO_CONGESTION_MANAGER,
+                     &opts->share, sizeof(opts->share)) < 0)
+    {
+        return -1;
+    }
+
+    return 0;
+}
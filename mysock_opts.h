@@ -0,0 +1,34 @@
+/* mysock_opts.h--command-line options for mysocket applications
+ *
+ * the client and server take the same options for the mysocket options
+ * they set.  an application adds MYSOCK_OPTS_GETOPT to its own getopt()
+ * letters, hands any option it doesn't know to mysock_opts_parse(), and
+ * sets the results on its mysocket with mysock_opts_apply().
+ */
+
+#ifndef __MYSOCK_OPTS_H__
+#define __MYSOCK_OPTS_H__
+
+#include "mysock.h"
+
+/* getopt() letters for the options below, and their usage text */
+#define MYSOCK_OPTS_GETOPT  "c:m:e:r:g"
+#define MYSOCK_OPTS_USAGE   "[-c reno|newreno|cubic|bbr] [-m <mtu>] " \
+                            "[-e <segments>] [-r <bytes/s>] [-g]"
+
+/* the options given; anything not given is -1, for the default */
+typedef struct
+{
+    int cc;                     /* -c: congestion control (MYCC_*) */
+    int mtu;                    /* -m: packet size limit (MYSO_MTU) */
+    int fec;                    /* -e: FEC group size (MYSO_FEC) */
+    int rate;                   /* -r: emulated link rate (MYSO_LINK_RATE) */
+    int share;                  /* -g: MYSO_CONGESTION_MANAGER */
+} mysock_opts_t;
+
+
+extern void mysock_opts_init(mysock_opts_t *opts);
+extern int mysock_opts_parse(mysock_opts_t *opts, int opt, const char *arg);
+extern int mysock_opts_apply(const mysock_opts_t *opts, mysocket_t sd);
+
+#endif  /* __MYSOCK_OPTS_H__ */
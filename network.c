@@ -6,6 +6,8 @@
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -13,14 +15,39 @@
 #include "mysock_impl.h"
 #include "network.h"
 #include "network_io.h"
-#include "transport.h"  /* for dprintf() */
+#include "tcp_sum.h"
+#include "transport.h"  /* for dprintf(), STCPHeader */
 
 
+/* how long the emulated link's queue (MYSO_LINK_RATE) may take to drain
+ * before the link marks packets, or drops those it can't mark, and
+ * before it drops everything
+ */
+#define LINK_MARK_DELAY     5000    /* microseconds */
+#define LINK_DROP_DELAY     100000
+
+/* a packet waiting on the emulated link */
+typedef struct link_packet
+{
+    struct link_packet *next;
+    uint64_t departs;   /* when the link has finished sending it */
+    size_t   len;       /* bytes following this header */
+} link_packet_t;
+
+
+static ssize_t _network_transmit(mysock_context_t *sock_ctx,
+                                 const void *buf, size_t len);
+static void _network_link_send(mysock_context_t *sock_ctx,
+                               const void *buf, size_t len);
+static void _network_start_link(network_context_t *ctx);
+static void *_network_link_thread(void *arg);
+static uint64_t _network_now(void);
 
 
 /* helper function for stcp_network_send(); this takes care of unreliable
  * delivery simulation, etc, before passing a packet off to
- * _network_send_packet() for actual transmission over the network.
+ * _network_send_packet() for actual transmission over the network (by way
+ * of the emulated link, if MYSO_LINK_RATE is set).
  */
 int _network_send(mysocket_t sd, const void *buf, size_t len)
 {
@@ -43,14 +70,19 @@ int _network_send(mysocket_t sd, const void *buf, size_t len)
         case 1:
             /* send duplicate */
             dprintf("====>network_send:duplicating the packet\n");
-            _network_send_packet(ctx, buf, len);
+            _network_transmit(sock_ctx, buf, len);
             break;
 
         case 2:
             /* store the packet in our queue. Will send it later */
             dprintf("====>network_send:keeping the packet in our queue\n");
-            assert(len <= sizeof(ctx->copy_buffer));
-            memcpy(&ctx->copy_buffer, buf, len);
+            if (len > ctx->copy_buf_size)
+            {
+                ctx->copy_buffer = (char *) realloc(ctx->copy_buffer, len);
+                assert(ctx->copy_buffer);
+                ctx->copy_buf_size = len;
+            }
+            memcpy(ctx->copy_buffer, buf, len);
             ctx->copy_buf_len = len;
             ctx->copied = TRUE;
             return len;
@@ -63,12 +95,13 @@ int _network_send(mysocket_t sd, const void *buf, size_t len)
             {
                 dprintf("====>network_send:sending the packet stored "
                         "in our queue\n");
-                _network_send_packet(ctx, ctx->copy_buffer, ctx->copy_buf_len);
+                _network_transmit(sock_ctx, ctx->copy_buffer,
+                                  ctx->copy_buf_len);
             }
             else
             {
                 dprintf("====>network_send:duplicating the packet\n");
-                _network_send_packet(ctx, buf, len);
+                _network_transmit(sock_ctx, buf, len);
             }
             return len;
 
@@ -78,7 +111,7 @@ int _network_send(mysocket_t sd, const void *buf, size_t len)
         }
     }
 
-    return _network_send_packet(ctx, buf, len);
+    return _network_transmit(sock_ctx, buf, len);
 }
 
 /* helper function for stcp_network_recv() */
@@ -94,3 +127,175 @@ int _network_recv(mysocket_t sd, void *dst, size_t max_len)
     return len;
 }
 
+void _network_stop_link(mysock_context_t *sock_ctx)
+{
+    network_context_t *ctx;
+
+    assert(sock_ctx);
+    ctx = &sock_ctx->network_state;
+
+    if (!ctx->link_started)
+        return;
+
+    PTHREAD_CALL(pthread_mutex_lock(&ctx->link_lock));
+    ctx->link_stopping = TRUE;
+    PTHREAD_CALL(pthread_mutex_unlock(&ctx->link_lock));
+    PTHREAD_CALL(pthread_cond_signal(&ctx->link_cond));
+    PTHREAD_CALL(pthread_join(ctx->link_thread, NULL));
+
+    assert(!ctx->link_head);
+    PTHREAD_CALL(pthread_cond_destroy(&ctx->link_cond));
+    PTHREAD_CALL(pthread_mutex_destroy(&ctx->link_lock));
+    ctx->link_started = FALSE;
+}
+
+
+/* send a packet, by way of the emulated link if there is one.  once the
+ * link has been used, everything goes that way, so packets leave in order
+ * and only the link thread writes to the network.
+ */
+static ssize_t _network_transmit(mysock_context_t *sock_ctx,
+                                 const void *buf, size_t len)
+{
+    network_context_t *ctx = &sock_ctx->network_state;
+
+    if (sock_ctx->options[MYSO_LINK_RATE] > 0 || ctx->link_started)
+    {
+        _network_link_send(sock_ctx, buf, len);
+        return len;     /* any error sending it goes unreported */
+    }
+
+    return _network_send_packet(ctx, buf, len);
+}
+
+/* queue a packet on the emulated link, to leave once the link has had
+ * time to send it after everything ahead of it.  if the queue has grown
+ * too long, the packet is marked "congestion experienced" if its
+ * transport can take that instead of a loss, or else dropped--unless the
+ * mysocket is reliable, in which case only marks are used.
+ */
+static void _network_link_send(mysock_context_t *sock_ctx,
+                               const void *buf, size_t len)
+{
+    network_context_t *ctx = &sock_ctx->network_state;
+    unsigned int rate = (unsigned int) sock_ctx->options[MYSO_LINK_RATE];
+    const STCPHeader *hdr = (const STCPHeader *) buf;
+    link_packet_t *p;
+    uint64_t now, backlog;
+
+    assert(buf && len >= sizeof(STCPHeader));
+
+    if (!ctx->link_started)
+        _network_start_link(ctx);
+
+    now = _network_now();
+    ctx->link_busy = MAX(ctx->link_busy, now);
+    backlog = ctx->link_busy - now;
+
+    if (backlog > LINK_MARK_DELAY && !ctx->is_reliable &&
+        (backlog > LINK_DROP_DELAY || !(hdr->th_x2 & TH_X2_ECT)))
+    {
+        dprintf("====>network_send:link congested, dropping the packet\n");
+        return;
+    }
+
+    p = (link_packet_t *) malloc(sizeof(*p) + len);
+    assert(p);
+    memcpy(p + 1, buf, len);
+    p->next = NULL;
+    p->len = len;
+
+    if (backlog > LINK_MARK_DELAY && (hdr->th_x2 & TH_X2_ECT))
+    {
+        dprintf("====>network_send:link congested, marking the packet\n");
+        ((STCPHeader *) (p + 1))->th_x2 |= TH_X2_CE;
+        _mysock_set_checksum(sock_ctx, p + 1, len);
+    }
+
+    if (rate > 0)
+        ctx->link_busy += (uint64_t) len * 1000000 / rate;
+    p->departs = ctx->link_busy;
+
+    PTHREAD_CALL(pthread_mutex_lock(&ctx->link_lock));
+    if (ctx->link_tail)
+        ctx->link_tail->next = p;
+    else
+        ctx->link_head = p;
+    ctx->link_tail = p;
+    PTHREAD_CALL(pthread_mutex_unlock(&ctx->link_lock));
+    PTHREAD_CALL(pthread_cond_signal(&ctx->link_cond));
+}
+
+static void _network_start_link(network_context_t *ctx)
+{
+    pthread_condattr_t cond_attr;
+
+    assert(ctx && !ctx->link_started);
+
+    PTHREAD_CALL(pthread_mutex_init(&ctx->link_lock, NULL));
+    PTHREAD_CALL(pthread_condattr_init(&cond_attr));
+    PTHREAD_CALL(pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC));
+    PTHREAD_CALL(pthread_cond_init(&ctx->link_cond, &cond_attr));
+    PTHREAD_CALL(pthread_condattr_destroy(&cond_attr));
+
+    ctx->link_stopping = FALSE;
+    ctx->link_thread = _mysock_create_thread(_network_link_thread, ctx, FALSE);
+    ctx->link_started = TRUE;
+}
+
+/* emulated link thread: send each queued packet at its departure time.
+ * once the link is being stopped, whatever's left goes straight away.
+ */
+static void *_network_link_thread(void *arg)
+{
+    network_context_t *ctx = (network_context_t *) arg;
+    link_packet_t *p;
+
+    assert(ctx);
+
+    PTHREAD_CALL(pthread_mutex_lock(&ctx->link_lock));
+    for (;;)
+    {
+        if (!(p = ctx->link_head))
+        {
+            if (ctx->link_stopping)
+                break;
+            PTHREAD_CALL(pthread_cond_wait(&ctx->link_cond, &ctx->link_lock));
+            continue;
+        }
+
+        if (!ctx->link_stopping && p->departs > _network_now())
+        {
+            struct timespec abstime;
+            int rc;
+
+            abstime.tv_sec = p->departs / 1000000;
+            abstime.tv_nsec = (p->departs % 1000000) * 1000;
+            rc = pthread_cond_timedwait(&ctx->link_cond, &ctx->link_lock,
+                                        &abstime);
+            assert(rc == 0 || rc == ETIMEDOUT);
+            continue;
+        }
+
+        if (!(ctx->link_head = p->next))
+            ctx->link_tail = NULL;
+        PTHREAD_CALL(pthread_mutex_unlock(&ctx->link_lock));
+
+        (void) _network_send_packet(ctx, p + 1, p->len);
+        free(p);
+
+        PTHREAD_CALL(pthread_mutex_lock(&ctx->link_lock));
+    }
+    PTHREAD_CALL(pthread_mutex_unlock(&ctx->link_lock));
+
+    return NULL;
+}
+
+/* current time in microseconds, on the monotonic clock */
+static uint64_t _network_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
@@ -7,8 +7,15 @@
 
 #include "mysock.h"
 
+struct mysock_context;
+
 int _network_send(mysocket_t sd, const void *buf, size_t len);
 int _network_recv(mysocket_t sd, void *dst, size_t max_len);
 
+/* send anything still waiting on the emulated link (MYSO_LINK_RATE), and
+ * stop its thread.  this does nothing if the link was never used.
+ */
+void _network_stop_link(struct mysock_context *ctx);
+
 #endif  /* __NETWORK_H__ */
 
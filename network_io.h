@@ -9,12 +9,15 @@
 #ifdef LINUX
 #include <stdint.h>
 #endif
+#include <pthread.h>
 #include "mysock.h"
 
+/* default packet size limit (MYSO_MTU) */
 #define MAX_IP_PAYLOAD_LEN 1500
 
 
 struct mysock_context;
+struct link_packet;
 
 /* network layer context, one instance per mysocket */
 typedef struct
@@ -34,11 +37,28 @@ typedef struct
     /* additional (opaque) data used by underlying I/O implementation */
     void *impl_data;
 
-    /* packet reordering/duplication simulation */
+    /* packet reordering/duplication simulation.  copy_buffer is grown as
+     * needed to hold the delayed packet.
+     */
     unsigned int random_seed;
     bool_t       copied;
-    char         copy_buffer[MAX_IP_PAYLOAD_LEN];
+    char        *copy_buffer;
+    size_t       copy_buf_size;
     size_t       copy_buf_len;
+
+    /* the emulated bottleneck (MYSO_LINK_RATE).  once it's first used,
+     * every packet goes through link_queue, oldest first, and link_thread
+     * sends each one when the link is done with those ahead of it;
+     * link_busy is when it'll be done with them all.
+     */
+    bool_t              link_started;
+    bool_t              link_stopping;
+    struct link_packet *link_head;
+    struct link_packet *link_tail;
+    uint64_t            link_busy;  /* us, on the monotonic clock */
+    pthread_t           link_thread;
+    pthread_mutex_t     link_lock;
+    pthread_cond_t      link_cond;
 } network_context_t;
 
 
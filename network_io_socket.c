@@ -207,7 +207,8 @@ int _network_bind_socket(network_context_t *ctx,
  */
 static void *network_recv_thread_func(void *arg_ptr)
 {
-    char packet_buf[MAX_IP_PAYLOAD_LEN];
+    char *packet_buf;
+    size_t packet_buf_len;
     mysock_context_t *ctx;
     network_context_socket_t *net_ctx;
 
@@ -215,6 +216,11 @@ static void *network_recv_thread_func(void *arg_ptr)
     ctx = (mysock_context_t *) arg_ptr;
     assert(ctx);
 
+    /* the peer is never told it can send more than this */
+    packet_buf_len = ctx->options[MYSO_MTU];
+    packet_buf = (char *) malloc(packet_buf_len);
+    assert(packet_buf);
+
     net_ctx = (network_context_socket_t *) ctx->network_state.impl_data;
     assert(net_ctx);
 
@@ -262,13 +268,13 @@ static void *network_recv_thread_func(void *arg_ptr)
          */
         if ((bytes_read = _network_recv_packet(&ctx->network_state,
                                                packet_buf,
-                                               sizeof(packet_buf))) <= 0)
+                                               packet_buf_len)) <= 0)
         {
             DEBUG_LOG(("_network_recv_packet interrupted, errno=%d\n", errno));
             break;
         }
 
-        assert(bytes_read <= (int)sizeof(packet_buf));
+        assert(bytes_read <= (ssize_t) packet_buf_len);
         if (ctx->listening)
         {
             /* if the socket was accepting new connections, incoming
@@ -287,6 +293,7 @@ static void *network_recv_thread_func(void *arg_ptr)
         }
     }
 
+    free(packet_buf);
     return NULL;
 }
 
@@ -5,6 +5,8 @@
 #include <assert.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <alloca.h>
@@ -19,6 +21,7 @@ typedef ssize_t (*io_func_t)(socket_t sd, void *buf, size_t count);
 
 static int _tcp_io(socket_t, void *, size_t, io_func_t);
 static int _tcp_connect(network_context_t *ctx);
+static void _tcp_nodelay(socket_t tcp_sd);
 
 
 /* a few words about using TCP to emulate the underlying datagram
@@ -33,6 +36,10 @@ static int _tcp_connect(network_context_t *ctx);
  *   - the passive side dispatches the SYN packet to the right STCP
  *     context, and updates the new context's TCP socket to be that of the
  *     newly accepted (real TCP) connection.
+ *   - Nagle's algorithm is disabled on these connections, so each packet
+ *     is handed to the peer as soon as it's sent, as it would be by a
+ *     datagram service.  otherwise a sender with only a segment or two
+ *     in flight stalls on the real TCP's delayed ACKs.
  */
 
 
@@ -150,6 +157,7 @@ ssize_t _network_send_packet(network_context_t *ctx,
     if (_tcp_connect(ctx) < 0)
         return -1;
 
+    assert(len <= 0xffff);  /* what the length prefix can describe */
     packet_len = htons(len);
     if (_tcp_io(GET_SOCKET(ctx), &packet_len, sizeof(packet_len),
                 (io_func_t) write) < 0 ||
@@ -194,6 +202,7 @@ ssize_t _network_recv_packet(network_context_t *ctx, void *dst, size_t max_len)
         }
 
         DEBUG_LOG(("accepted from peer, tmp_sd=%d...\n", (int) tmp_sd));
+        _tcp_nodelay(tmp_sd);
 
         /* keep listening socket open for futher connection requests */
         /* we will not reenter this function until this SYN packet has
@@ -233,6 +242,7 @@ ssize_t _network_recv_packet(network_context_t *ctx, void *dst, size_t max_len)
         /* discard unread remainder of packet */
         char *dummy = (char *) alloca(packet_len - max_len);
         (void) _tcp_io(io_socket, dummy, packet_len - max_len, read);
+        return max_len;
     }
 
     return packet_len;
@@ -290,6 +300,7 @@ static int _tcp_connect(network_context_t *ctx)
             return -1;
         }
 
+        _tcp_nodelay(GET_SOCKET(ctx));
         tcp_io_ctx->connected = TRUE;
     }
     PTHREAD_CALL(pthread_mutex_unlock(&tcp_io_ctx->connect_lock));
@@ -297,3 +308,14 @@ static int _tcp_connect(network_context_t *ctx)
     return 0;
 }
 
+/* send packets as soon as they're written; see the comments at the top */
+static void _tcp_nodelay(socket_t tcp_sd)
+{
+    int one = 1;
+
+    if (setsockopt(tcp_sd, IPPROTO_TCP, TCP_NODELAY,
+                   (char *) &one, sizeof(one)) < 0)
+    {
+        DEBUG_LOG(("setsockopt(TCP_NODELAY) failed (errno=%d)\n", errno));
+    }
+}
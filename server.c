@@ -23,10 +23,11 @@
 #include <assert.h>
 
 #include "mysock.h"
+#include "mysock_opts.h"
 
 
 
-static char usage[] = "usage: %s [-U]\n";
+static char usage[] = "usage: %s [-U] " MYSOCK_OPTS_USAGE "\n";
 
 static void do_connection(mysocket_t bindsd);
 static int get_nvt_line(int sd, char *);
@@ -42,10 +43,12 @@ main(int argc, char *argv[])
     int len, opt, errflg = 0;
     char localname[256];
     bool_t reliable = TRUE;
+    mysock_opts_t sockopts;
 
 
     /* Parse the command line */
-    while ((opt = getopt(argc, argv, "U")) != EOF)
+    mysock_opts_init(&sockopts);
+    while ((opt = getopt(argc, argv, "U" MYSOCK_OPTS_GETOPT)) != EOF)
     {
         switch (opt)
         {
@@ -55,6 +58,10 @@ main(int argc, char *argv[])
         case '?':
             ++errflg;
             break;
+        default:
+            if (mysock_opts_parse(&sockopts, opt, optarg) < 0)
+                ++errflg;
+            break;
         }
     }
 
@@ -71,6 +78,13 @@ main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
+    /* accepted connections inherit the listening socket's options */
+    if (mysock_opts_apply(&sockopts, bindsd) < 0)
+    {
+        perror("mysetsockopt");
+        exit(EXIT_FAILURE);
+    }
+
     memset(&sin, 0, sizeof(sin));
     sin.sin_family = AF_INET;
     sin.sin_addr.s_addr = htonl(INADDR_ANY);
@@ -123,7 +137,7 @@ main(int argc, char *argv[])
 static void do_connection(mysocket_t sd)
 {
     char line[256];
-    int rc;
+    int rc, cork;
 
 
     /* loop over: 
@@ -138,7 +152,17 @@ static void do_connection(mysocket_t sd)
             goto done;
         fprintf(stderr, "client: %s\n", line);
 
-        if (process_line(sd, line) < 0)
+        /* the response header and the start of the file share segments,
+         * rather than the header going out in one of its own; uncorking
+         * sends whatever is left of the file.
+         */
+        cork = 1;
+        (void) mysetsockopt(sd, MYSO_CORK, &cork, sizeof(cork));
+        rc = process_line(sd, line);
+        cork = 0;
+        (void) mysetsockopt(sd, MYSO_CORK, &cork, sizeof(cork));
+
+        if (rc < 0)
         {
             perror("process_line");
             goto done;
@@ -1,6 +1,7 @@
 /* stcp_api.c--transport layer interfaces to the mysock and network layers */
 
 #include <pthread.h>
+#include <alloca.h>
 #include <stdarg.h>
 #include <string.h>
 #include <errno.h>
@@ -51,8 +52,8 @@ void stcp_unblock_application(mysocket_t sd)
 /* called by the transport layer to wait for new data, either from the network
  * or from the application, or for the application to request that the
  * mysocket be closed, depending on the value of flags.  abstime is the
- * absolute time at which the function should quit waiting; if NULL, it blocks
- * indefinitely until data arrives.
+ * absolute time (on the monotonic clock) at which the function should quit
+ * waiting; if NULL, it blocks indefinitely until data arrives.
  *
  * sd is the mysocket descriptor for the connection of interest.
  *
@@ -86,6 +87,22 @@ unsigned int stcp_wait_for_event(mysocket_t             sd,
             rc |= APP_CLOSE_REQUESTED;
         }
 
+        if ((flags & APP_FLUSH_REQUESTED) &&
+            ctx->flush_requested && (ctx->app_recv_queue.head == NULL))
+        {
+            /* likewise, only once the data to be flushed has been passed
+             * down to STCP.
+             */
+            ctx->flush_requested = FALSE;
+            rc |= APP_FLUSH_REQUESTED;
+        }
+
+        if ((flags & APP_DATA_READ) && ctx->data_read)
+        {
+            ctx->data_read = FALSE;
+            rc |= APP_DATA_READ;
+        }
+
         if (rc)
             break;
 
@@ -144,6 +161,33 @@ void *stcp_get_context(mysocket_t sd)
     return ctx->stcp_state;
 }
 
+int stcp_get_option(mysocket_t sd, int optname)
+{
+    mysock_context_t *ctx = _mysock_get_context(sd);
+
+    assert(ctx);
+    assert(optname >= 0 && optname < MYSO_NUM_OPTIONS);
+    return ctx->options[optname];
+}
+
+size_t stcp_network_mtu(mysocket_t sd)
+{
+    mysock_context_t *ctx = _mysock_get_context(sd);
+
+    assert(ctx);
+    return ctx->options[MYSO_MTU];
+}
+
+uint32_t stcp_network_peer(mysocket_t sd)
+{
+    mysock_context_t *ctx = _mysock_get_context(sd);
+
+    assert(ctx && ctx->network_state.peer_addr_valid);
+    assert(ctx->network_state.peer_addr.sa_family == AF_INET);
+    return ((struct sockaddr_in *)
+            &ctx->network_state.peer_addr)->sin_addr.s_addr;
+}
+
 /* stcp_network_recv
  *
  * Receive a datagram from the peer.  The call blocks until data is
@@ -192,7 +236,7 @@ ssize_t stcp_network_recv(mysocket_t sd, void *dst, size_t max_len)
 ssize_t stcp_network_send(mysocket_t sd, const void *src, size_t src_len, ...)
 {
     mysock_context_t *ctx = _mysock_get_context(sd);
-    char              packet[MAX_IP_PAYLOAD_LEN];
+    char             *packet;
     size_t            packet_len;
     const void       *next_buf;
     va_list           argptr;
@@ -200,7 +244,16 @@ ssize_t stcp_network_send(mysocket_t sd, const void *src, size_t src_len, ...)
 
     assert(ctx && src);
 
-    assert(src_len <= sizeof(packet));
+    /* total up the buffers, so the packet can be assembled in one place */
+    packet_len = src_len;
+    va_start(argptr, src_len);
+    while ((next_buf = va_arg(argptr, const void *)))
+        packet_len += va_arg(argptr, size_t);
+    va_end(argptr);
+
+    assert(packet_len <= MYSO_MTU_MAX);
+    packet = (char *) alloca(packet_len);
+
     memcpy(packet, src, src_len);
     packet_len = src_len;
 
@@ -209,7 +262,6 @@ ssize_t stcp_network_send(mysocket_t sd, const void *src, size_t src_len, ...)
     {
         size_t next_len = va_arg(argptr, size_t);
 
-        assert(packet_len + next_len <= sizeof(packet));
         memcpy(packet + packet_len, next_buf, next_len);
         packet_len += next_len;
     }
@@ -240,14 +292,20 @@ ssize_t stcp_network_send(mysocket_t sd, const void *src, size_t src_len, ...)
 size_t stcp_app_recv(mysocket_t sd, void *dst, size_t max_len)
 {
     mysock_context_t *ctx = _mysock_get_context(sd);
+    size_t len;
+
     assert(ctx && dst);
 
     /* app may have passed in data of arbitrary length; all of it must be
      * passed down to the transport layer.  if it doesn't fit in the specified
      * buffer, any left over is kept for the next call to app_recv().
      */
-    return _mysock_dequeue_buffer(ctx, &ctx->app_recv_queue,
-                                  dst, max_len, TRUE);
+    len = _mysock_dequeue_buffer(ctx, &ctx->app_recv_queue,
+                                 dst, max_len, TRUE);
+
+    /* that made room for mywrite() to queue more */
+    _mysock_notify_send_space(ctx);
+    return len;
 }
 
 /* pass data up to the application for consumption by myread() */
@@ -263,6 +321,21 @@ void stcp_app_send(mysocket_t sd, const void *src, size_t src_len)
     }
 }
 
+/* returns the number of bytes passed up to the application that it
+ * hasn't read yet
+ */
+size_t stcp_app_unread(mysocket_t sd)
+{
+    mysock_context_t *ctx = _mysock_get_context(sd);
+    size_t len;
+
+    assert(ctx);
+    PTHREAD_CALL(pthread_mutex_lock(&ctx->data_ready_lock));
+    len = ctx->app_send_queue.len;
+    PTHREAD_CALL(pthread_mutex_unlock(&ctx->data_ready_lock));
+    return len;
+}
+
 void stcp_fin_received(mysocket_t sd)
 {
     mysock_context_t *ctx = _mysock_get_context(sd);
@@ -17,7 +17,10 @@ typedef enum
     APP_DATA            = 1,
     NETWORK_DATA        = 2,
     APP_CLOSE_REQUESTED = 4,
-    ANY_EVENT           = APP_DATA | NETWORK_DATA | APP_CLOSE_REQUESTED
+    APP_FLUSH_REQUESTED = 8,
+    APP_DATA_READ       = 16,
+    ANY_EVENT           = APP_DATA | NETWORK_DATA | APP_CLOSE_REQUESTED |
+                          APP_FLUSH_REQUESTED | APP_DATA_READ
 } stcp_event_type_t;
 
 
@@ -31,20 +34,25 @@ void stcp_unblock_application(mysocket_t sd);
 /* called by the transport layer to wait for new data, either from the network
  * or from the application, or for the application to request that the
  * socket be closed via myclose(), depending on the value of wait_flags.
- * abstime is the absolute time at which the function should quit waiting
- * (i.e., the value of the system clock at which the timeout should be
- * indicated; it has the same origin as time(2) and gettimeofday(2), so a
- * structure containing all zeros corresponds to 00:00:00 GMT, January 1,
- * 1970); if the timeout pointer is NULL, the function blocks indefinitely
- * until data arrives.  the close event is triggered only once, once all
- * pending data has been dequeued from the application.
+ * abstime is the absolute time at which the function should quit waiting,
+ * on the monotonic clock (i.e., the value clock_gettime(CLOCK_MONOTONIC)
+ * will have reached when the timeout should be indicated; unlike the
+ * system time, this never jumps); if the timeout pointer is NULL, the
+ * function blocks indefinitely until data arrives.  the close event is
+ * triggered only once, once all pending data has been dequeued from the
+ * application.  the flush event (from myflush(), or the application
+ * removing MYSO_CORK or setting MYSO_NODELAY) works the same way: it
+ * means everything dequeued so far should be sent without waiting to fill
+ * a segment.  the data read event means the application has called
+ * myread() since the last one, so some of what was passed up with
+ * stcp_app_send() has been consumed (see stcp_app_unread()).
  *
  * sd is the mysocket descriptor for the connection of interest.
  *
  * the function returns a bit mask corresponding to an application data
- * arriving/network data arriving/close event, of the same format as the flags
- * passed (see the stcp_event_type_t enum above).  one or more bits may be
- * set, if multiple events have occurred.
+ * arriving/network data arriving/close/flush event, of the same format as
+ * the flags passed (see the stcp_event_type_t enum above).  one or more
+ * bits may be set, if multiple events have occurred.
  *
  * if an event has occurred since the last call to stcp_wait_for_event(), or
  * the system time has already reached the absolute time specified to the
@@ -71,6 +79,21 @@ unsigned int stcp_wait_for_event(mysocket_t             sd,
 void stcp_set_context(mysocket_t sd, const void *stcp_state);
 void *stcp_get_context(mysocket_t my_sd);
 
+/* returns the current value of a mysocket option (see MYSO_* in mysock.h),
+ * as set by the application with mysetsockopt().
+ */
+int stcp_get_option(mysocket_t sd, int optname);
+
+/* returns the largest STCP packet (header, options and data) that the
+ * network layer can carry for this mysocket.
+ */
+size_t stcp_network_mtu(mysocket_t sd);
+
+/* returns the peer's IP address, in network byte order.  the peer is
+ * known by the time transport_init() is called, on either side.
+ */
+uint32_t stcp_network_peer(mysocket_t sd);
+
 /* Receive a datagram from the peer.
  *
  * sd       Mysocket descriptor.
@@ -104,6 +127,12 @@ size_t stcp_app_recv(mysocket_t sd, void *dst, size_t max_len);
 /* pass data up to the application for consumption by myread() */
 void stcp_app_send(mysocket_t sd, const void *src, size_t src_len);
 
+/* returns the number of bytes passed up with stcp_app_send() that the
+ * application has yet to read.  nothing stops you passing up more, but
+ * this is what limits the receive window.
+ */
+size_t stcp_app_unread(mysocket_t sd);
+
 /* once you receive a FIN segment from the peer, we need to let the
  * application know there's no more data arriving (by returning 0 bytes for
  * subsequent myread() calls).  call stcp_fin_received() to indicate the
@@ -15,13 +15,191 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <time.h>
+#include <arpa/inet.h>
 #include "mysock.h"
 #include "stcp_api.h"
 #include "transport.h"
+#include "transport_cc.h"
+#include "transport_cm.h"
+#include "transport_metrics.h"
+#include "transport_opt.h"
+#include "transport_timer.h"
 
 
-enum { CSTATE_ESTABLISHED };    /* obviously you should have more states */
+enum
+{
+    CSTATE_LISTEN,
+    CSTATE_SYN_SENT,
+    CSTATE_SYN_RCVD,
+    CSTATE_ESTABLISHED,
+    CSTATE_FIN_WAIT_1,
+    CSTATE_FIN_WAIT_2,
+    CSTATE_CLOSING,
+    CSTATE_CLOSE_WAIT,
+    CSTATE_LAST_ACK
+};
+
+/* the connection's timers, as identified to stcp_timer_advance() */
+enum
+{
+    TIMER_RTO,      /* retransmission */
+    TIMER_DELACK,   /* delayed ACK */
+    TIMER_CORK,     /* corked data held back too long */
+    TIMER_PACE,     /* pacing lets the next segment go */
+    TIMER_PERSIST,  /* probe the peer's zero window */
+    TIMER_RACK,     /* a reordering window ends */
+    TIMER_TLP       /* send a tail loss probe */
+};
+
+/* size of the send ring, i.e. the most data that can be buffered between
+ * the application and the network, and so the most that can be in flight.
+ * this must be a power of two.
+ */
+#define SEND_RING_SIZE      (1 << 20)
+
+/* the receive buffer, i.e. the most data we'll hold that the application
+ * hasn't read yet, and so the window advertised to the peer.  it starts
+ * at RECEIVE_WINDOW_INITIAL and is tuned to the transfer rate, up to
+ * MYSO_RCVBUF but never beyond RECEIVE_RING_SIZE, the most the ring
+ * holding out-of-order data within the window can grow to (a power of
+ * two).  unless the peer agrees to window scaling, the window is cut down
+ * to what fits in th_win.
+ */
+#define RECEIVE_WINDOW_INITIAL  (64 * 1024)
+#define RECEIVE_RING_SIZE   (1 << 20)
+
+/* the buffer is sized to hold twice what the application reads in a
+ * round trip, plus this many segments of slack, so the peer is never held
+ * up by the window (see rcvbuf_adjust())
+ */
+#define RECEIVE_SLACK_SEGMENTS  16
+
+/* largest window th_win can carry unscaled */
+#define TCP_MAXWIN          65535
+
+/* smallest MSS we'll go down to, whatever the peer asks for */
+#define MIN_MSS             64
+
+/* retransmission timeout bounds (microseconds), and the number of
+ * consecutive timeouts for the same data before we give up on the peer.
+ * RTO_INITIAL applies until the first RTT sample (RFC 6298).
+ */
+#define RTO_INITIAL         1000000
+#define RTO_MIN             200000
+#define RTO_MAX             60000000
+#define RTO_GRANULARITY     1000
+#define MAX_RETRANSMITS     6
+
+/* timestamps are taken from a microsecond clock (the resolution of the
+ * RTT estimator), which wraps every 71 minutes.  a peer's timestamp left
+ * unrefreshed for longer than PAWS_IDLE can't be compared with reliably,
+ * so it's no longer used to reject segments (RFC 7323, section 5.5).
+ */
+#define PAWS_IDLE           ((uint64_t) 30 * 60 * 1000000)
+
+/* with delayed ACKs, how long (microseconds) an ACK may be held back
+ * waiting for a second segment or outgoing data to ride on (RFC 1122
+ * allows up to 500ms)
+ */
+#define DELACK_TIMEOUT      40000
+
+/* after a sign of loss or reordering, ACK this many segments at once
+ * before delaying ACKs again, so the sender's recovery gets every ACK
+ */
+#define QUICKACK_SEGMENTS   16
+
+/* longest (microseconds) a corked connection holds back a partial
+ * segment, in case the application forgets to uncork
+ */
+#define CORK_TIMEOUT        200000
+
+/* duplicate ACKs that trigger a fast retransmit (RFC 5681), to begin
+ * with.  each time reordering turns out to have set one off needlessly,
+ * the connection's threshold is raised past the run of duplicates that
+ * was seen, up to the maximum.
+ */
+#define DUPACK_THRESHOLD    3
+#define DUPACK_THRESHOLD_MAX    32
+
+/* RACK's reordering window is a quarter of the minimum RTT, times a
+ * multiplier that goes up each time reordering is found to have caused a
+ * needless retransmission, and back to one after this many recoveries
+ * without that (RFC 8985, section 6.2)
+ */
+#define RACK_REO_RECOVERIES 16
+
+/* most segment transmissions logged at once for RACK loss detection (a
+ * power of two).  anything sent while the log is full is left to
+ * duplicate ACKs and the retransmission timer.
+ */
+#define XMIT_LOG_SIZE       4096
+
+/* shortest wait (microseconds) before a tail loss probe, so that a
+ * little scheduling delay on a fast path isn't taken for a lost tail
+ */
+#define TLP_MIN_TIMEOUT     10000
+
+/* most disjoint blocks of sequence space tracked in a seq_blocks_t, i.e.
+ * SACKed ranges held by the sender, or out-of-order ranges held by the
+ * receiver
+ */
+#define SEQ_BLOCKS_MAX      16
+
+/* a paced sender may send this long's worth (microseconds) of data back
+ * to back, but at least PACING_BURST_SEGMENTS: the depth of its token
+ * bucket.  a burst is as long as waiting out the gap after it costs.
+ */
+#define PACING_BURST_TIME   250
+#define PACING_BURST_SEGMENTS   2
+
+/* without a rate from congestion control, pacing spreads cwnd over the
+ * smoothed RTT, faster by these percentages so the window can still grow:
+ * doubling while in slow start, more gently after (as Linux does)
+ */
+#define PACING_SS_RATIO     200
+#define PACING_CA_RATIO     120
+
+
+/* sequence-indexed ring buffer holding data from the application that has
+ * not yet been acknowledged by the peer.  the byte with sequence number s
+ * lives at buf[s & (size - 1)], so a segment can be (re)built from any
+ * sequence number in [start, start + len) without tracking the boundaries
+ * of previously sent segments.
+ */
+typedef struct
+{
+    char    *buf;
+    uint32_t size;      /* capacity in bytes; a power of two */
+    tcp_seq  start;     /* sequence number of the first byte held */
+    uint32_t len;       /* number of bytes held */
+} seq_ring_t;
+
+/* a set of blocks of sequence space, kept disjoint (adjacent blocks are
+ * merged) and sorted by sequence number
+ */
+typedef struct
+{
+    unsigned int n;
+    stcp_sack_block_t blocks[SEQ_BLOCKS_MAX];
+} seq_blocks_t;
+
+/* one transmission of a segment, as logged for RACK */
+typedef struct
+{
+    tcp_seq  start;     /* sequence space covered, FIN included */
+    tcp_seq  end;
+    uint64_t sent;      /* when it was sent */
+    unsigned int flags; /* XMIT_* */
+} xmit_t;
+
+#define XMIT_RETRANSMIT 1   /* resent data */
+#define XMIT_DELIVERED  2   /* acknowledged or SACKed */
+#define XMIT_STALE      4   /* resent (or being resent) since */
 
+/* the k-th oldest entry in a connection's transmission log */
+#define XMIT_AT(ctx, k) \
+    ((ctx)->xmits[((ctx)->xmit_head + (k)) & (XMIT_LOG_SIZE - 1)])
 
 /* this structure is global to a mysocket descriptor */
 typedef struct
@@ -31,12 +209,344 @@ typedef struct
     int connection_state;   /* state of the connection (established, etc.) */
     tcp_seq initial_sequence_num;
 
-    /* any other connection-wide global variables go here */
+    /* send sequence space */
+    tcp_seq  snd_una;   /* oldest unacknowledged sequence number */
+    tcp_seq  snd_nxt;   /* next sequence number to send */
+    tcp_seq  snd_max;   /* highest sequence number sent so far */
+    uint32_t snd_wnd;   /* window advertised by the peer */
+    tcp_seq  snd_wl1;   /* segment seq used for the last window update */
+    tcp_seq  snd_wl2;   /* segment ack used for the last window update */
+    bool_t   fin_pending;   /* app has closed; FIN follows buffered data */
+
+    seq_ring_t send_ring;   /* unacknowledged and unsent app data */
+
+    /* segment sizes, settled by the MSS options on the SYNs.  our
+     * segments carry at most snd_mss bytes of options and data; mss is
+     * the data in a full-sized one, after the options every segment
+     * carries.
+     */
+    uint32_t mtu;           /* largest packet the network layer carries */
+    uint32_t rcv_mss;       /* MSS we advertise */
+    uint32_t snd_mss;
+    uint32_t mss;
+    char    *recv_buf;      /* mtu bytes each, for incoming segments... */
+    char    *send_buf;      /* ...and for building outgoing ones */
+
+    /* coalescing of small writes.  data below push_seq has been flushed
+     * by the application and goes out whatever its size.
+     */
+    bool_t   nodelay;           /* TRUE if Nagle's algorithm is off */
+    bool_t   corked;            /* TRUE if only full segments may be sent */
+    tcp_seq  push_seq;          /* end of the data last flushed */
+    tcp_seq  snd_small;         /* end of the last partial segment sent */
+    stcp_timer_t cork_timer;    /* when held data must go */
+
+    /* selective acknowledgements.  sack_enabled starts out as what we'd
+     * like, and after the handshake says whether the peer agreed.
+     */
+    bool_t   sack_enabled;
+    seq_blocks_t scoreboard;    /* what the peer holds above snd_una */
+
+    /* window scaling (RFC 7323), negotiated the same way as SACK.  the
+     * shifts apply to th_win on everything but SYNs.
+     */
+    bool_t   wscale_enabled;
+    unsigned int snd_wscale;    /* shift the peer applies to its window */
+    unsigned int rcv_wscale;    /* shift we apply to ours */
+
+    /* timestamps (RFC 7323), negotiated the same way as SACK.  once
+     * agreed, every segment carries one, and the peer's are kept to echo
+     * back and to reject old duplicates (PAWS).
+     */
+    bool_t   ts_enabled;
+    uint32_t ts_recent;         /* timestamp to echo to the peer */
+    uint64_t ts_recent_age;     /* when ts_recent was recorded */
+    tcp_seq  last_ack_sent;     /* th_ack on the last ACK we sent */
+
+    /* explicit congestion notification (RFC 3168), negotiated the same
+     * way as SACK.  new data goes out ECN-capable.  a mark the network
+     * puts on the peer's data is echoed on every ACK until the peer
+     * says it has reduced its window; a mark on ours reduces the window
+     * at most once per window of data.
+     */
+    bool_t   ecn_enabled;
+    bool_t   ece_pending;       /* TRUE while marks need echoing */
+    bool_t   cwr_pending;       /* TRUE until new data has carried CWR */
+    tcp_seq  ecn_recover;       /* snd_max at the last reduction */
+
+    /* receive sequence space */
+    tcp_seq  irs;       /* peer's initial sequence number */
+    tcp_seq  rcv_nxt;   /* next sequence number expected from the peer */
+    uint32_t rcv_buf;   /* most unread data we'll hold for the app */
+    uint32_t rcv_buf_max;   /* ...which autotuning may grow it to */
+    tcp_seq  rcv_adv;   /* right edge of the window advertised so far */
+    bool_t   fin_seen;  /* TRUE once the peer's FIN has arrived... */
+    tcp_seq  fin_seq;   /* ...occupying this sequence number */
+
+    /* out-of-order data.  bytes are held in recv_ring at their sequence
+     * numbers, which start at rcv_nxt; reass says which are present.  the
+     * ring is only allocated once something arrives out of order, and is
+     * only as big as the window it has had to cover.
+     */
+    seq_ring_t   recv_ring;
+    seq_blocks_t reass;
+    tcp_seq  reass_last;    /* start of the latest out-of-order arrival */
+
+    /* acknowledgements owed to the peer */
+    bool_t   delayed_ack;       /* TRUE if ACKs may be delayed */
+    bool_t   ack_now;           /* send an ACK at the end of this pass */
+    unsigned int quickacks;     /* segments left to ACK without delay */
+    uint32_t ack_bytes;         /* data received but not yet ACKed */
+    stcp_timer_t delack_timer;  /* latest time to ACK it */
+
+    /* retransmission timer */
+    stcp_timer_t rto_timer;
+    uint32_t rto;               /* timeout from the RTT estimate */
+    unsigned int retransmits;   /* consecutive timeouts (backoff shift) */
+
+    /* round-trip time estimation (Jacobson/Karels).  with timestamps,
+     * every ACK for new data gives a sample.  without, one segment at a
+     * time is timed; per Karn's rule, the measurement is abandoned if
+     * that segment is retransmitted.
+     */
+    uint32_t srtt;              /* smoothed RTT, or 0 before any sample */
+    uint32_t rttvar;            /* RTT mean deviation */
+    bool_t   rtt_timing;        /* TRUE while a segment is being timed */
+    tcp_seq  rtt_seq;           /* sequence number of the timed segment */
+    uint64_t rtt_start;         /* when the timed segment was sent */
+    uint32_t min_rtt;           /* least RTT sample, or 0 */
+
+    /* the peer's entry in the metrics cache (MYSO_METRICS), looked up as
+     * the connection opens, and replaced as it closes.  srtt is 0 if
+     * there wasn't one.
+     */
+    bool_t   metrics_enabled;
+    uint32_t peer_addr;
+    stcp_metrics_t metrics;
+
+    /* the group of connections to the peer sharing congestion state
+     * (MYSO_CONGESTION_MANAGER), or NULL.  this connection sends no more
+     * than its share of the group's window, and takes its RTT estimate
+     * from the group's.
+     */
+    stcp_cm_group_t *cm;
+
+    /* receive buffer autotuning (dynamic right-sizing).  every round
+     * trip, the bytes the application has read give the rate the buffer
+     * has to keep up with; it's given back when the connection idles.
+     * the receiver's own RTT estimate comes from the timestamps the peer
+     * echoes on its data, or else from how long the peer takes to fill a
+     * window.
+     */
+    uint32_t rcv_rtt;           /* RTT seen by the receiver, or 0 */
+    uint32_t rcv_rtt_tsecr;     /* last echoed timestamp sampled */
+    tcp_seq  rcv_rtt_seq;       /* window edge whose arrival ends a sample */
+    uint64_t rcv_rtt_start;     /* ...and when it was advertised, or 0 */
+    tcp_seq  rcv_space_seq;     /* first byte read in this round trip */
+    uint64_t rcv_space_start;   /* when the round trip began */
+    uint32_t rcv_space;         /* most bytes read in a round trip */
+    uint64_t rcv_last;          /* when in-order data last arrived */
+
+    stcp_cc_t cc;               /* congestion control */
+
+    /* fast retransmit/recovery (RFC 5681, RFC 6582) */
+    unsigned int dupacks;       /* consecutive duplicate ACKs */
+    unsigned int dupthresh;     /* ...that trigger a fast retransmit */
+    tcp_seq  recover;           /* snd_max at the last loss */
+
+    /* undoing a loss response that was spurious: the data had only been
+     * reordered or delayed.  that shows up when the ACK for the first
+     * retransmission echoes the timestamp of the original (Eifel, RFC
+     * 3522), or when the peer reports every byte resent as a duplicate
+     * with D-SACKs (RFC 3708).  the window goes back to what it was, and
+     * loss detection allows for more reordering from then on.
+     */
+    bool_t   undo_active;       /* TRUE while a response may be undone */
+    bool_t   undo_rto;          /* ...which the RTO started */
+    tcp_seq  undo_marker;       /* snd_una when it began... */
+    tcp_seq  undo_recover;      /* ...and snd_max */
+    uint32_t undo_cwnd;         /* window before it */
+    uint32_t undo_ssthresh;
+    seq_blocks_t undo_resent;   /* data resent since */
+    uint32_t undo_retrans;      /* ...bytes not yet reported duplicate */
+    bool_t   undo_timed;        /* snd_una was resent with a timestamp... */
+    uint32_t undo_tsval;        /* ...this one */
+    unsigned int undo_dupacks;  /* longest run of duplicate ACKs since */
+    uint32_t undo_cm_cut;       /* taken off the group's window since */
+
+    /* D-SACK (RFC 2883): a duplicate segment from the peer, to report
+     * in the first SACK block of the next ACK
+     */
+    bool_t   dsack_pending;
+    stcp_sack_block_t dsack;
+
+    /* RACK-TLP loss detection (RFC 8985).  every segment sent is logged,
+     * oldest first.  once one is delivered, any sent before it that's
+     * still outstanding a reordering window later is taken as lost.  a
+     * tail loss probe, sent when ACKs stop coming in, makes sure some
+     * later segment gets delivered to show up a loss at the tail.
+     */
+    xmit_t  *xmits;             /* XMIT_LOG_SIZE entries, in a ring */
+    unsigned int xmit_head;     /* the oldest logged... */
+    unsigned int xmit_n;        /* ...of this many */
+    unsigned int xmit_resent;   /* ...of which retransmissions */
+    uint64_t rack_sent;         /* latest send time of anything delivered */
+    tcp_seq  rack_end;          /* ...and the end of that segment */
+    uint32_t rack_rtt;          /* RTT measured from it */
+    stcp_timer_t rack_timer;    /* the next reordering window ends */
+    stcp_timer_t tlp_timer;     /* when to probe */
+    bool_t   tlp_active;        /* TRUE if a probe is out... */
+    bool_t   tlp_resent;        /* ...which resent data... */
+    tcp_seq  tlp_end;           /* ...until this is acknowledged */
+    unsigned int rack_reo_mult; /* reordering window multiplier */
+    unsigned int rack_reo_clean;    /* recoveries since it went up */
+
+    /* forward error correction.  each group of fec_group new segments
+     * (fewer when the data pauses) is followed by a parity segment, their
+     * XOR, from which the peer can rebuild any one of them that's lost
+     * without waiting for it to be resent.  the segments of a group are
+     * all one size, bar a shorter last one, so the peer can tell where
+     * each one lies.
+     */
+    unsigned int fec_group;     /* segments per parity segment, or 0 */
+    unsigned int fec_count;     /* segments in the current group... */
+    tcp_seq  fec_start;         /* ...covering [fec_start, fec_end)... */
+    tcp_seq  fec_end;
+    uint32_t fec_len;           /* ...in pieces this long... */
+    bool_t   fec_fin;           /* ...plus the FIN, if TRUE */
+    char    *fec_parity;        /* their XOR, fec_len bytes */
+
+    /* for rebuilding the peer's data from its parity: the latest data
+     * passed up to the application, which any group with a piece still
+     * missing can only reach back so far into.  it's only kept once
+     * parity starts arriving.
+     */
+    seq_ring_t fec_history;
+    char    *fec_buf;           /* mtu bytes, for a rebuilt segment */
+
+    /* probing of a zero window (RFC 1122, section 4.2.2.17) */
+    stcp_timer_t persist_timer;
+    unsigned int persists;      /* probes without the window opening */
+
+    /* pacing.  each segment sent takes its length in tokens from a
+     * bucket, which fills at the pacing rate up to a short burst's
+     * worth; output that finds it short waits for the pace timer.  the
+     * rate is congestion control's own, if it paces, or else (with
+     * MYSO_PACING) cwnd over the RTT, capped at MYSO_MAX_PACING_RATE.
+     */
+    bool_t   pacing;            /* TRUE to pace whatever the algorithm */
+    uint64_t max_pacing_rate;   /* bytes/s, or 0 for no cap */
+    uint64_t pace_tokens;       /* in bytes * 10^6 (one per byte-us/s)... */
+    uint64_t pace_stamp;        /* ...as of this time */
+    stcp_timer_t pace_timer;    /* wakes output waiting for tokens */
+
+    stcp_timer_wheel_t timers;  /* holds all the above timers */
 } context_t;
 
 
 static void generate_initial_seq_num(context_t *ctx);
 static void control_loop(mysocket_t sd, context_t *ctx);
+static void process_segment(mysocket_t sd, context_t *ctx,
+                            const char *packet, ssize_t packet_len);
+static bool_t header_predicted(mysocket_t sd, context_t *ctx,
+                               const STCPHeader *hdr,
+                               const char *data, uint32_t data_len);
+static void acknowledge(context_t *ctx, bool_t delay_ack, uint32_t data_len);
+static void process_ack(mysocket_t sd, context_t *ctx,
+                        const STCPHeader *hdr, const stcp_opts_t *opts,
+                        bool_t pure_ack);
+static void ack_advance(mysocket_t sd, context_t *ctx, tcp_seq ack,
+                        const stcp_opts_t *opts);
+static void duplicate_ack(mysocket_t sd, context_t *ctx, tcp_seq ack);
+static void enter_recovery(context_t *ctx);
+static void undo_begin(context_t *ctx, bool_t rto);
+static void undo_resend(context_t *ctx, tcp_seq seq, uint32_t len,
+                        const stcp_opts_t *opts);
+static void undo_eifel(mysocket_t sd, context_t *ctx,
+                       const stcp_opts_t *opts);
+static void undo_dsack(mysocket_t sd, context_t *ctx,
+                       tcp_seq start, tcp_seq end);
+static void undo(mysocket_t sd, context_t *ctx);
+static void retransmit_head(mysocket_t sd, context_t *ctx);
+static void retransmit_range(mysocket_t sd, context_t *ctx,
+                             tcp_seq start, tcp_seq end);
+static bool_t receive_data(mysocket_t sd, context_t *ctx, tcp_seq seq,
+                           const char *data, uint32_t data_len,
+                           bool_t has_fin, const stcp_opts_t *opts);
+static void deliver(mysocket_t sd, context_t *ctx,
+                    const char *data, uint32_t len);
+static void receive_fin(mysocket_t sd, context_t *ctx);
+static void transport_output(mysocket_t sd, context_t *ctx);
+static void retransmit_timeout(mysocket_t sd, context_t *ctx);
+static void send_segment(mysocket_t sd, context_t *ctx, tcp_seq seq,
+                         uint8_t flags, uint32_t data_len);
+static void abort_connection(context_t *ctx, int error);
+static bool_t hold_partial_segment(context_t *ctx, uint32_t len);
+static void negotiate_wscale(context_t *ctx, const stcp_opts_t *opts);
+static void negotiate_timestamps(context_t *ctx, const stcp_opts_t *opts);
+static void negotiate_fec(context_t *ctx, const stcp_opts_t *opts);
+static void negotiate_ecn(context_t *ctx, const STCPHeader *hdr);
+static void ecn_echoed(context_t *ctx, tcp_seq ack);
+static void negotiate_mss(mysocket_t sd, context_t *ctx,
+                          const stcp_opts_t *opts);
+static bool_t paws_reject(const context_t *ctx, const stcp_opts_t *opts);
+static unsigned int window_shift(uint32_t wnd);
+static void schedule_ack(context_t *ctx, uint32_t data_len);
+static void arm_rto(context_t *ctx);
+static bool_t pacing_allows(context_t *ctx, uint32_t len);
+static uint32_t send_cwnd(const context_t *ctx);
+static uint64_t pacing_rate(const context_t *ctx);
+static void sack_update(seq_blocks_t *sb, const stcp_opts_t *opts,
+                        tcp_seq snd_una, tcp_seq snd_max);
+static tcp_seq sack_skip(const seq_blocks_t *sb, tcp_seq seq,
+                         uint32_t *len);
+static void reass_insert(context_t *ctx, tcp_seq seq,
+                         const char *data, uint32_t len);
+static void reass_deliver(mysocket_t sd, context_t *ctx);
+static unsigned int reass_sack_blocks(const context_t *ctx,
+                                      stcp_sack_block_t *blocks,
+                                      unsigned int max_blocks);
+static bool_t blocks_add(seq_blocks_t *b, tcp_seq start, tcp_seq end);
+static void blocks_trim(seq_blocks_t *b, tcp_seq seq);
+static uint32_t rtt_ack(context_t *ctx, tcp_seq ack,
+                        const stcp_opts_t *opts);
+static uint32_t current_rto(const context_t *ctx, unsigned int backoff);
+static void arm_persist(context_t *ctx);
+static void persist_probe(mysocket_t sd, context_t *ctx);
+static uint32_t receive_window(mysocket_t sd, const context_t *ctx);
+static uint16_t advertise_window(mysocket_t sd, context_t *ctx,
+                                 uint8_t flags);
+static bool_t window_update_due(mysocket_t sd, const context_t *ctx);
+static void rcv_rtt_measure(context_t *ctx, const stcp_opts_t *opts);
+static void rcvbuf_adjust(mysocket_t sd, context_t *ctx, bool_t gap);
+
+static void xmit_log(context_t *ctx, tcp_seq seq, tcp_seq end);
+static bool_t xmit_resent(const context_t *ctx, tcp_seq seq);
+static void rack_ack(mysocket_t sd, context_t *ctx);
+static void rack_delivered(context_t *ctx, xmit_t *x, uint64_t now);
+static void rack_detect_loss(mysocket_t sd, context_t *ctx);
+static void arm_tlp(context_t *ctx);
+static void tlp_probe(mysocket_t sd, context_t *ctx);
+static void fec_add(mysocket_t sd, context_t *ctx, tcp_seq seq,
+                    const char *data, uint32_t len, bool_t fin);
+static void fec_flush(mysocket_t sd, context_t *ctx);
+static bool_t fec_recover(mysocket_t sd, context_t *ctx, tcp_seq start,
+                          const char *parity, uint32_t len, bool_t has_fin,
+                          const stcp_opts_t *opts);
+static void fec_xor(const context_t *ctx, tcp_seq seq,
+                    char *buf, uint32_t len);
+
+static void ring_init(seq_ring_t *r, uint32_t size, tcp_seq start);
+static void ring_grow(seq_ring_t *r, uint32_t size);
+static uint32_t ring_read_app(mysocket_t sd, seq_ring_t *r);
+static void ring_copy_out(const seq_ring_t *r, tcp_seq seq,
+                          void *dst, uint32_t len);
+static void ring_consume(seq_ring_t *r, uint32_t len);
+static void ring_store(seq_ring_t *r, tcp_seq seq,
+                       const void *src, uint32_t len);
+static void ring_append(seq_ring_t *r, const void *src, uint32_t len);
+
+static uint64_t current_time(void);
 
 
 /* initialise the transport layer, and start the main loop, handling
@@ -52,19 +562,99 @@ void transport_init(mysocket_t sd, bool_t is_active)
 
     generate_initial_seq_num(ctx);
 
-    /* XXX: you should send a SYN packet here if is_active, or wait for one
-     * to arrive if !is_active.  after the handshake completes, unblock the
-     * application with stcp_unblock_application(sd).  you may also use
-     * this to communicate an error condition back to the application, e.g.
-     * if connection fails; to do so, just set errno appropriately (e.g. to
-     * ECONNREFUSED, etc.) before calling the function.
+    ctx->snd_una = ctx->snd_nxt = ctx->snd_max = ctx->initial_sequence_num;
+    ctx->recover = ctx->ecn_recover = ctx->initial_sequence_num;
+    ctx->dupthresh = DUPACK_THRESHOLD;
+    ctx->rack_reo_mult = 1;
+    ctx->push_seq = ctx->snd_small = ctx->initial_sequence_num;
+    ctx->rto = RTO_INITIAL;
+    stcp_timer_wheel_init(&ctx->timers, current_time());
+    stcp_timer_init(&ctx->rto_timer, TIMER_RTO);
+    stcp_timer_init(&ctx->delack_timer, TIMER_DELACK);
+    stcp_timer_init(&ctx->cork_timer, TIMER_CORK);
+    stcp_timer_init(&ctx->pace_timer, TIMER_PACE);
+    stcp_timer_init(&ctx->persist_timer, TIMER_PERSIST);
+    stcp_timer_init(&ctx->rack_timer, TIMER_RACK);
+    stcp_timer_init(&ctx->tlp_timer, TIMER_TLP);
+    ring_init(&ctx->send_ring, SEND_RING_SIZE, ctx->initial_sequence_num + 1);
+    ctx->xmits = (xmit_t *) malloc(XMIT_LOG_SIZE * sizeof(xmit_t));
+    assert(ctx->xmits);
+
+    /* congestion control is set up once the handshake settles the MSS */
+    ctx->mtu = stcp_network_mtu(sd);
+    assert(ctx->mtu >= sizeof(STCPHeader) + MAX_TCP_OPTIONS_LEN + MIN_MSS);
+    ctx->rcv_mss = MIN(ctx->mtu - sizeof(STCPHeader), 0xffff);
+    ctx->snd_mss = ctx->mss = STCP_MSS;
+    ctx->recv_buf = (char *) malloc(ctx->mtu);
+    ctx->send_buf = (char *) malloc(ctx->mtu);
+    assert(ctx->recv_buf && ctx->send_buf);
+    ctx->sack_enabled = stcp_get_option(sd, MYSO_SACK) != 0;
+    ctx->wscale_enabled = stcp_get_option(sd, MYSO_WINDOW_SCALE) != 0;
+    ctx->rcv_buf_max = MIN((uint32_t) stcp_get_option(sd, MYSO_RCVBUF),
+                           RECEIVE_RING_SIZE);
+    ctx->rcv_buf = MIN(RECEIVE_WINDOW_INITIAL, ctx->rcv_buf_max);
+    ctx->rcv_wscale = window_shift(ctx->rcv_buf_max);
+    ctx->ts_enabled = stcp_get_option(sd, MYSO_TIMESTAMPS) != 0;
+    ctx->ecn_enabled = stcp_get_option(sd, MYSO_ECN) != 0;
+    ctx->delayed_ack = stcp_get_option(sd, MYSO_DELAYED_ACK) != 0;
+    ctx->fec_group = (unsigned int) stcp_get_option(sd, MYSO_FEC);
+
+    /* a host seen before gives a better first RTO than RTO_INITIAL; the
+     * window has to wait for congestion control (see negotiate_mss())
+     */
+    ctx->metrics_enabled = stcp_get_option(sd, MYSO_METRICS) != 0;
+    ctx->peer_addr = stcp_network_peer(sd);
+    if (ctx->metrics_enabled &&
+        stcp_metrics_lookup(ctx->peer_addr, current_time(), &ctx->metrics))
+    {
+        ctx->rto = ctx->metrics.srtt +
+                   MAX(RTO_GRANULARITY, 4 * ctx->metrics.rttvar);
+        ctx->rto = MIN(MAX(ctx->rto, RTO_MIN), RTO_MAX);
+        dprintf("cached metrics: srtt=%u rttvar=%u rto=%u\n",
+                ctx->metrics.srtt, ctx->metrics.rttvar, ctx->rto);
+    }
+
+    /* the active side opens with a SYN; the passive side finds the peer's
+     * SYN already waiting in its network queue.  control_loop() unblocks
+     * the application with stcp_unblock_application() once the handshake
+     * completes, or leaves errno set if the connection can't be made.
      */
-    ctx->connection_state = CSTATE_ESTABLISHED;
-    stcp_unblock_application(sd);
+    if (is_active)
+    {
+        ctx->connection_state = CSTATE_SYN_SENT;
+        send_segment(sd, ctx, ctx->initial_sequence_num, TH_SYN, 0);
+    }
+    else
+    {
+        ctx->connection_state = CSTATE_LISTEN;
+    }
 
     control_loop(sd, ctx);
 
+    /* leave what was learnt for the next connection to the peer, unless
+     * the connection never measured the path, or gave up on it
+     */
+    if (ctx->metrics_enabled && ctx->srtt && ctx->cc.ops &&
+        ctx->retransmits == 0)
+    {
+        ctx->metrics.srtt = ctx->srtt;
+        ctx->metrics.rttvar = ctx->rttvar;
+        ctx->metrics.ssthresh = stcp_cc_ssthresh(&ctx->cc);
+        ctx->metrics.cwnd = stcp_cc_cwnd(&ctx->cc);
+        stcp_metrics_store(ctx->peer_addr, current_time(), &ctx->metrics);
+    }
+    if (ctx->cm)
+        stcp_cm_leave(ctx->cm);
+
     /* do any cleanup here */
+    free(ctx->recv_ring.buf);
+    free(ctx->send_ring.buf);
+    free(ctx->xmits);
+    free(ctx->fec_parity);
+    free(ctx->fec_history.buf);
+    free(ctx->fec_buf);
+    free(ctx->recv_buf);
+    free(ctx->send_buf);
     free(ctx);
 }
 
@@ -78,8 +668,7 @@ static void generate_initial_seq_num(context_t *ctx)
     /* please don't change this! */
     ctx->initial_sequence_num = 1;
 #else
-    /* you have to fill this up */
-    /*ctx->initial_sequence_num =;*/
+    ctx->initial_sequence_num = (tcp_seq) (rand() % 256);
 #endif
 }
 
@@ -93,25 +682,2688 @@ static void generate_initial_seq_num(context_t *ctx)
  */
 static void control_loop(mysocket_t sd, context_t *ctx)
 {
+    static const struct timespec no_wait = { 0, 0 };
+
     assert(ctx);
 
     while (!ctx->done)
     {
-        unsigned int event;
+        unsigned int event, wait_flags;
+        struct timespec abstime, *timeout = NULL;
+        uint64_t deadline;
+        uint32_t expired;
+
+        /* only pull more data from the application while there's room to
+         * hold it until it's acknowledged; anything else stays queued in
+         * the mysocket layer until the peer opens the window.
+         */
+        wait_flags = NETWORK_DATA | APP_CLOSE_REQUESTED |
+                     APP_FLUSH_REQUESTED;
+        if ((ctx->connection_state == CSTATE_ESTABLISHED ||
+             ctx->connection_state == CSTATE_CLOSE_WAIT) &&
+            ctx->send_ring.len < ctx->send_ring.size)
+        {
+            wait_flags |= APP_DATA;
+        }
+
+        /* once the peer's been left with less than half the window, hear
+         * about the application reading, so it can be opened again
+         * without waiting for more data (or a probe) from the peer
+         */
+        if ((ctx->connection_state == CSTATE_ESTABLISHED ||
+             ctx->connection_state == CSTATE_FIN_WAIT_1 ||
+             ctx->connection_state == CSTATE_FIN_WAIT_2) &&
+            ctx->rcv_adv - ctx->rcv_nxt < ctx->rcv_buf / 2)
+        {
+            wait_flags |= APP_DATA_READ;
+        }
+
+        if ((deadline = stcp_timer_next(&ctx->timers)) != 0)
+        {
+            abstime.tv_sec  = deadline / 1000000;
+            abstime.tv_nsec = (deadline % 1000000) * 1000;
+            timeout = &abstime;
+        }
 
         /* see stcp_api.h or stcp_api.c for details of this function */
-        /* XXX: you will need to change some of these arguments! */
-        event = stcp_wait_for_event(sd, 0, NULL);
+        event = stcp_wait_for_event(sd, wait_flags, timeout);
 
         /* check whether it was the network, app, or a close request */
+        if (event & NETWORK_DATA)
+        {
+            ssize_t packet_len;
+
+            packet_len = stcp_network_recv(sd, ctx->recv_buf, ctx->mtu);
+            process_segment(sd, ctx, ctx->recv_buf, packet_len);
+        }
+
         if (event & APP_DATA)
         {
-            /* the application has requested that data be sent */
-            /* see stcp_app_recv() */
+            unsigned int more;
+
+            /* the application has requested that data be sent.  take all
+             * of it that fits, so that small writes can share a segment.
+             */
+            do
+            {
+                (void) ring_read_app(sd, &ctx->send_ring);
+                more = 0;
+                if (ctx->send_ring.len < ctx->send_ring.size)
+                {
+                    more = stcp_wait_for_event(sd, APP_DATA |
+                                               APP_FLUSH_REQUESTED, &no_wait);
+                }
+                event |= more;
+            } while (more & APP_DATA);
+        }
+
+        if ((event & APP_DATA_READ) && window_update_due(sd, ctx))
+            ctx->ack_now = TRUE;
+
+        if (event & APP_FLUSH_REQUESTED)
+            ctx->push_seq = ctx->send_ring.start + ctx->send_ring.len;
+
+        if (event & APP_CLOSE_REQUESTED)
+        {
+            /* everything the app wrote is in the send ring by now, so the
+             * FIN goes out as soon as that data has been sent.
+             */
+            ctx->fin_pending = TRUE;
+            if (ctx->connection_state == CSTATE_ESTABLISHED)
+                ctx->connection_state = CSTATE_FIN_WAIT_1;
+            else if (ctx->connection_state == CSTATE_CLOSE_WAIT)
+                ctx->connection_state = CSTATE_LAST_ACK;
+        }
+
+        /* an expired pacing timer needs nothing more than the call to
+         * transport_output() below
+         */
+        expired = stcp_timer_advance(&ctx->timers, current_time());
+
+        if (!ctx->done && (expired & (1U << TIMER_RTO)))
+            retransmit_timeout(sd, ctx);
+
+        if (expired & (1U << TIMER_DELACK))
+            ctx->ack_now = TRUE;
+
+        if (expired & (1U << TIMER_CORK))
+            ctx->push_seq = ctx->send_ring.start + ctx->send_ring.len;
+
+        if (!ctx->done && (expired & (1U << TIMER_PERSIST)))
+            persist_probe(sd, ctx);
+
+        if (!ctx->done && (expired & (1U << TIMER_RACK)))
+            rack_detect_loss(sd, ctx);
+
+        /* a probe due in the same tick as the retransmission timer
+         * would only duplicate what that's resending
+         */
+        if (!ctx->done && (expired & (1U << TIMER_TLP)) &&
+            !(expired & (1U << TIMER_RTO)))
+        {
+            tlp_probe(sd, ctx);
+        }
+
+        ctx->nodelay = stcp_get_option(sd, MYSO_NODELAY) != 0;
+        ctx->corked = stcp_get_option(sd, MYSO_CORK) != 0;
+        ctx->pacing = stcp_get_option(sd, MYSO_PACING) != 0;
+        ctx->max_pacing_rate =
+            (uint64_t) stcp_get_option(sd, MYSO_MAX_PACING_RATE);
+
+        if (!ctx->done)
+            transport_output(sd, ctx);
+
+        /* any data just sent carried the ACK; otherwise send it alone.
+         * this includes the ACK for a FIN that has just finished the
+         * connection.  a bare ACK goes at snd_max, even while resending
+         * from further back, so the peer never takes it for a probe (and
+         * always takes its window).
+         */
+        if (ctx->ack_now)
+            send_segment(sd, ctx, ctx->snd_max, TH_ACK, 0);
+    }
+}
+
+
+/* handle a single segment arriving from the peer */
+static void process_segment(mysocket_t sd, context_t *ctx,
+                            const char *packet, ssize_t packet_len)
+{
+    const STCPHeader *hdr = (const STCPHeader *) packet;
+    const char *data;
+    tcp_seq seq;
+    uint32_t data_len;
+    bool_t has_fin, delay_ack = FALSE;
+    stcp_opts_t opts;
+
+    assert(ctx && packet);
+
+    if (packet_len < (ssize_t) sizeof(STCPHeader) ||
+        packet_len > (ssize_t) ctx->mtu ||
+        TCP_DATA_START(packet) < sizeof(STCPHeader) ||
+        (ssize_t) TCP_DATA_START(packet) > packet_len)
+    {
+        dprintf("dropping malformed segment (len=%d)\n", (int) packet_len);
+        return;
+    }
+
+    if (header_predicted(sd, ctx, hdr, packet + TCP_DATA_START(packet),
+                         packet_len - TCP_DATA_START(packet)))
+    {
+        return;
+    }
+
+    seq      = ntohl(hdr->th_seq);
+    data     = packet + TCP_DATA_START(packet);
+    data_len = packet_len - TCP_DATA_START(packet);
+    has_fin  = (hdr->th_flags & TH_FIN) != 0;
+    stcp_opt_parse(hdr, &opts);
+
+    switch (ctx->connection_state)
+    {
+    case CSTATE_LISTEN:
+        if (!(hdr->th_flags & TH_SYN))
+            return;
+
+        ctx->irs = seq;
+        ctx->rcv_nxt = ctx->rcv_adv = seq + 1;
+        ctx->snd_wnd = ntohs(hdr->th_win);
+        ctx->snd_wl1 = seq;
+        ctx->sack_enabled = ctx->sack_enabled && opts.sack_permitted;
+        negotiate_wscale(ctx, &opts);
+        negotiate_timestamps(ctx, &opts);
+        negotiate_fec(ctx, &opts);
+        negotiate_mss(sd, ctx, &opts);
+        negotiate_ecn(ctx, hdr);
+        ctx->connection_state = CSTATE_SYN_RCVD;
+        send_segment(sd, ctx, ctx->initial_sequence_num, TH_SYN | TH_ACK, 0);
+        return;
+
+    case CSTATE_SYN_SENT:
+        if ((hdr->th_flags & (TH_SYN | TH_ACK)) != (TH_SYN | TH_ACK) ||
+            ntohl(hdr->th_ack) != ctx->initial_sequence_num + 1)
+        {
+            return;
+        }
+
+        negotiate_timestamps(ctx, &opts);
+        rtt_ack(ctx, ntohl(hdr->th_ack), &opts);
+
+        ctx->irs = seq;
+        ctx->rcv_nxt = ctx->rcv_adv = seq + 1;
+        ctx->snd_una = ctx->snd_nxt = ctx->initial_sequence_num + 1;
+        ctx->snd_wnd = ntohs(hdr->th_win);
+        ctx->snd_wl1 = seq;
+        ctx->snd_wl2 = ntohl(hdr->th_ack);
+        ctx->sack_enabled = ctx->sack_enabled && opts.sack_permitted;
+        negotiate_wscale(ctx, &opts);
+        negotiate_fec(ctx, &opts);
+        negotiate_mss(sd, ctx, &opts);
+        negotiate_ecn(ctx, hdr);
+        stcp_timer_cancel(&ctx->timers, &ctx->rto_timer);
+        ctx->retransmits = 0;
+        ctx->connection_state = CSTATE_ESTABLISHED;
+        send_segment(sd, ctx, ctx->snd_max, TH_ACK, 0);
+        stcp_unblock_application(sd);
+        return;
+
+    case CSTATE_SYN_RCVD:
+        if ((hdr->th_flags & TH_SYN) && seq == ctx->irs)
+        {
+            /* our SYN-ACK went missing; the peer is still trying */
+            send_segment(sd, ctx, ctx->initial_sequence_num,
+                         TH_SYN | TH_ACK, 0);
+            return;
+        }
+
+        if (!(hdr->th_flags & TH_ACK) ||
+            ntohl(hdr->th_ack) != ctx->initial_sequence_num + 1)
+        {
+            return;
+        }
+
+        rtt_ack(ctx, ntohl(hdr->th_ack), &opts);
+
+        ctx->snd_una = ctx->initial_sequence_num + 1;
+        if (SEQ_LT(ctx->snd_nxt, ctx->snd_una))
+            ctx->snd_nxt = ctx->snd_una;
+        stcp_timer_cancel(&ctx->timers, &ctx->rto_timer);
+        ctx->retransmits = 0;
+        ctx->connection_state = CSTATE_ESTABLISHED;
+        stcp_unblock_application(sd);
+        break;  /* the ACK may carry data too */
+
+    default:
+        break;
+    }
+
+    if (paws_reject(ctx, &opts))
+    {
+        dprintf("PAWS: dropping old segment %u\n", seq);
+        if (data_len > 0 || has_fin)
+            ctx->ack_now = TRUE;
+        return;
+    }
+
+    /* a parity segment occupies no sequence space, and carries nothing
+     * else for us; it's only acknowledged if it rebuilt some data
+     */
+    if (opts.fec_present)
+    {
+        if (fec_recover(sd, ctx, seq, data, data_len, has_fin, &opts))
+        {
+            ctx->quickacks = QUICKACK_SEGMENTS;
+            ctx->ack_now = TRUE;
+        }
+        return;
+    }
+
+    /* the timestamp to echo is the one on the segment that moved the
+     * left edge of the window (RFC 7323, section 4.3), so a delayed ACK
+     * reports the RTT of the oldest segment it covers
+     */
+    if (ctx->ts_enabled && opts.ts_present &&
+        SEQ_LEQ(seq, ctx->last_ack_sent))
+    {
+        ctx->ts_recent = opts.ts_val;
+        ctx->ts_recent_age = current_time();
+    }
+
+    if (hdr->th_flags & TH_SYN)
+    {
+        /* a retransmitted SYN-ACK (our ACK was lost) or an old duplicate;
+         * either way, remind the peer where we are.
+         */
+        send_segment(sd, ctx, ctx->snd_max, TH_ACK, 0);
+        return;
+    }
+
+    /* a congestion mark is echoed until the peer has reacted to it
+     * (RFC 3168, section 6.1.3).  the first ACK to echo it goes at once.
+     */
+    if (ctx->ecn_enabled)
+    {
+        if (hdr->th_flags & TH_CWR)
+            ctx->ece_pending = FALSE;
+        if ((hdr->th_x2 & TH_X2_CE) && !ctx->ece_pending)
+        {
+            ctx->ece_pending = TRUE;
+            ctx->ack_now = TRUE;
+        }
+    }
+
+    if (hdr->th_flags & TH_ACK)
+    {
+        process_ack(sd, ctx, hdr, &opts, data_len == 0 && !has_fin);
+        if (ctx->done)
+            return;
+    }
+
+    if (data_len == 0 && !has_fin)
+    {
+        /* a pure ACK.  one from before rcv_nxt is a window probe (or a
+         * stray old duplicate), and is answered with an ACK giving the
+         * current window (RFC 793).
+         */
+        if (SEQ_LT(seq, ctx->rcv_nxt))
+            ctx->ack_now = TRUE;
+        return;
+    }
+
+    delay_ack = receive_data(sd, ctx, seq, data, data_len, has_fin, &opts);
+    acknowledge(ctx, delay_ack, data_len);
+}
+
+/* header prediction (Van Jacobson's, as in 4.4BSD).  on an established
+ * connection, nearly every segment is either the next in-order data,
+ * acknowledging nothing new, or a pure ACK for new data, with the window
+ * unchanged and no options but a timestamp.  such a segment is handled
+ * here without the general option parsing and state machine.  returns
+ * FALSE, having done nothing, for any other segment.
+ */
+static bool_t header_predicted(mysocket_t sd, context_t *ctx,
+                               const STCPHeader *hdr,
+                               const char *data, uint32_t data_len)
+{
+    tcp_seq seq = ntohl(hdr->th_seq), ack = ntohl(hdr->th_ack);
+    stcp_opts_t opts;
+
+    assert(ctx && hdr);
+
+    if (ctx->connection_state != CSTATE_ESTABLISHED ||
+        hdr->th_flags != TH_ACK || (hdr->th_x2 & TH_X2_CE) ||
+        seq != ctx->rcv_nxt ||
+        ((uint32_t) ntohs(hdr->th_win) << ctx->snd_wscale) != ctx->snd_wnd ||
+        !stcp_opt_parse_fast(hdr, &opts) || paws_reject(ctx, &opts))
+    {
+        return FALSE;
+    }
+
+    if (data_len == 0)
+    {
+        if (!SEQ_GT(ack, ctx->snd_una) || SEQ_GT(ack, ctx->snd_max))
+            return FALSE;
+    }
+    else if (ack != ctx->snd_una || ctx->reass.n > 0 || ctx->fin_seen ||
+             SEQ_GT(seq + data_len, ctx->rcv_adv))
+    {
+        return FALSE;
+    }
+
+    /* as in process_segment() and process_ack(), short of anything
+     * that can't apply
+     */
+    if (ctx->ts_enabled && opts.ts_present &&
+        SEQ_LEQ(seq, ctx->last_ack_sent))
+    {
+        ctx->ts_recent = opts.ts_val;
+        ctx->ts_recent_age = current_time();
+    }
+
+    if (SEQ_LT(ctx->snd_wl1, seq) ||
+        (ctx->snd_wl1 == seq && SEQ_LEQ(ctx->snd_wl2, ack)))
+    {
+        ctx->snd_wl1 = seq;
+        ctx->snd_wl2 = ack;
+    }
+
+    if (data_len == 0)
+    {
+        ack_advance(sd, ctx, ack, &opts);
+        return TRUE;
+    }
+
+    deliver(sd, ctx, data, data_len);
+    reass_deliver(sd, ctx);
+    rcv_rtt_measure(ctx, &opts);
+    rcvbuf_adjust(sd, ctx, FALSE);
+    acknowledge(ctx, TRUE, data_len);
+    return TRUE;
+}
+
+/* data_len bytes of data (or just a FIN) arrived, new, duplicate or out
+ * of order; all of it gets acknowledged.  unless delay_ack, the ACK goes
+ * straight away, as it does for the next few segments: duplicate and
+ * out-of-order segments are ACKed at once, to drive the peer's fast
+ * retransmit (RFC 5681, section 4.2).
+ */
+static void acknowledge(context_t *ctx, bool_t delay_ack, uint32_t data_len)
+{
+    assert(ctx);
+
+    if (!delay_ack)
+        ctx->quickacks = QUICKACK_SEGMENTS;
+
+    if (delay_ack && ctx->delayed_ack && ctx->quickacks == 0)
+        schedule_ack(ctx, data_len);
+    else
+        ctx->ack_now = TRUE;
+
+    if (delay_ack && ctx->quickacks > 0)
+        --ctx->quickacks;
+}
+
+/* take data (and a FIN) from the peer starting at seq, either as it
+ * arrived or as rebuilt from parity.  returns TRUE if it needn't be
+ * acknowledged straight away.
+ */
+static bool_t receive_data(mysocket_t sd, context_t *ctx, tcp_seq seq,
+                           const char *data, uint32_t data_len,
+                           bool_t has_fin, const stcp_opts_t *opts)
+{
+    tcp_seq wnd_end;
+    bool_t delay_ack = FALSE;
+
+    assert(ctx && (data || data_len == 0) && opts);
+
+    if (ctx->connection_state != CSTATE_ESTABLISHED &&
+        ctx->connection_state != CSTATE_FIN_WAIT_1 &&
+        ctx->connection_state != CSTATE_FIN_WAIT_2)
+    {
+        return FALSE;
+    }
+
+    /* trim anything we've already passed up to the application */
+    if (SEQ_LT(seq, ctx->rcv_nxt))
+    {
+        uint32_t dup = ctx->rcv_nxt - seq;
+
+        if (dup > data_len)
+        {
+            dup = data_len;
+            has_fin = FALSE;    /* retransmitted FIN, already seen */
         }
 
-        /* etc. */
+        if (dup > 0)
+        {
+            ctx->dsack_pending = TRUE;
+            ctx->dsack.start = seq;
+            ctx->dsack.end = seq + dup;
+        }
+
+        data += dup;
+        data_len -= dup;
+        seq += dup;
+    }
+
+    /* ...and anything beyond the window we advertised */
+    wnd_end = ctx->rcv_adv;
+    if (SEQ_GEQ(seq, wnd_end))
+    {
+        data_len = 0;
+        has_fin = FALSE;
+    }
+    else if (SEQ_GT(seq + data_len, wnd_end))
+    {
+        data_len = wnd_end - seq;
+        has_fin = FALSE;
+    }
+
+    if (has_fin && !ctx->fin_seen)
+    {
+        ctx->fin_seen = TRUE;
+        ctx->fin_seq = seq + data_len;
     }
+
+    /* in-order data goes straight to the application, along with any
+     * held data it joins up with.  out-of-order data is held until the
+     * gap before it fills (and reported to the peer in SACK blocks).
+     */
+    if (seq == ctx->rcv_nxt)
+    {
+        /* only the ACK for plain in-order data may be delayed; one that
+         * fills a gap or covers a FIN is news to the sender
+         */
+        bool_t gap = (ctx->reass.n > 0);
+
+        delay_ack = (data_len > 0 && !has_fin && !gap);
+
+        if (data_len > 0)
+            deliver(sd, ctx, data, data_len);
+        reass_deliver(sd, ctx);
+
+        if (data_len > 0)
+        {
+            rcv_rtt_measure(ctx, opts);
+            rcvbuf_adjust(sd, ctx, gap);
+        }
+    }
+    else if (data_len > 0)
+    {
+        reass_insert(ctx, seq, data, data_len);
+    }
+
+    if (ctx->fin_seen && ctx->rcv_nxt == ctx->fin_seq)
+    {
+        receive_fin(sd, ctx);
+        delay_ack = FALSE;
+    }
+
+    return delay_ack;
+}
+
+/* pass in-order data up to the application, keeping a copy if it may be
+ * needed to rebuild data from parity
+ */
+static void deliver(mysocket_t sd, context_t *ctx,
+                    const char *data, uint32_t len)
+{
+    assert(ctx && data);
+
+    stcp_app_send(sd, data, len);
+    if (ctx->fec_history.buf)
+        ring_append(&ctx->fec_history, data, len);
+    ctx->rcv_nxt += len;
+}
+
+/* the peer's FIN is next in sequence; everything before it has been
+ * passed up to the application.
+ */
+static void receive_fin(mysocket_t sd, context_t *ctx)
+{
+    assert(ctx && ctx->fin_seen && ctx->rcv_nxt == ctx->fin_seq);
+
+    ctx->rcv_nxt++;
+    stcp_fin_received(sd);
+
+    if (ctx->connection_state == CSTATE_ESTABLISHED)
+        ctx->connection_state = CSTATE_CLOSE_WAIT;
+    else if (ctx->connection_state == CSTATE_FIN_WAIT_1)
+        ctx->connection_state = CSTATE_CLOSING;
+    else
+        ctx->done = TRUE;   /* FIN_WAIT_2; no TIME_WAIT */
+}
+
+/* process the acknowledgement, window and SACK blocks carried by an
+ * incoming segment.  pure_ack is TRUE if the segment carries neither data
+ * nor a FIN.
+ */
+static void process_ack(mysocket_t sd, context_t *ctx,
+                        const STCPHeader *hdr, const stcp_opts_t *opts,
+                        bool_t pure_ack)
+{
+    tcp_seq ack = ntohl(hdr->th_ack);
+    tcp_seq seq = ntohl(hdr->th_seq);
+    uint32_t old_wnd = ctx->snd_wnd;
+
+    assert(ctx && hdr && opts);
+
+    if (SEQ_LT(ack, ctx->snd_una) || SEQ_GT(ack, ctx->snd_max))
+        return;     /* old, or acknowledges something we never sent */
+
+    /* the window is taken from the most recent segment (RFC 793) */
+    if (SEQ_LT(ctx->snd_wl1, seq) ||
+        (ctx->snd_wl1 == seq && SEQ_LEQ(ctx->snd_wl2, ack)))
+    {
+        ctx->snd_wnd = (uint32_t) ntohs(hdr->th_win) << ctx->snd_wscale;
+        ctx->snd_wl1 = seq;
+        ctx->snd_wl2 = ack;
+    }
+
+    if (ctx->sack_enabled && opts->num_sack > 0)
+    {
+        /* a first block below the ACK, or inside the second block, is a
+         * D-SACK: it reports a duplicate, not data held out of order
+         * (RFC 2883)
+         */
+        if (SEQ_LT(opts->sack[0].start, ack) ||
+            (opts->num_sack > 1 &&
+             SEQ_GEQ(opts->sack[0].start, opts->sack[1].start) &&
+             SEQ_LEQ(opts->sack[0].end, opts->sack[1].end)))
+        {
+            undo_dsack(sd, ctx, opts->sack[0].start, opts->sack[0].end);
+        }
+        sack_update(&ctx->scoreboard, opts, ack, ctx->snd_max);
+    }
+
+    if (ctx->ecn_enabled && (hdr->th_flags & TH_ECE))
+        ecn_echoed(ctx, ack);
+
+    if (ack == ctx->snd_una)
+    {
+        /* only an ACK that tells us nothing else counts as a duplicate
+         * (RFC 5681): no data, no window update, and data outstanding.
+         */
+        if (pure_ack && ctx->snd_wnd == old_wnd &&
+            ctx->snd_una != ctx->snd_max)
+        {
+            duplicate_ack(sd, ctx, ack);
+        }
+        if (opts->num_sack > 0)
+            rack_ack(sd, ctx);
+        return;
+    }
+
+    ack_advance(sd, ctx, ack, opts);
+}
+
+/* ack acknowledges new data (and perhaps our FIN): pass it on to
+ * congestion control, drop the data from the send ring, and restart the
+ * timers for whatever is left.
+ */
+static void ack_advance(mysocket_t sd, context_t *ctx, tcp_seq ack,
+                        const stcp_opts_t *opts)
+{
+    uint32_t acked = ack - ctx->snd_una;
+    uint32_t data_acked = MIN(acked, ctx->send_ring.len);
+    bool_t fin_acked = (acked > data_acked);
+    stcp_cc_ack_t cc_ack;
+
+    if (ctx->undo_timed && SEQ_GT(ack, ctx->undo_marker))
+        undo_eifel(sd, ctx, opts);
+
+    cc_ack.ack         = ack;
+    cc_ack.bytes_acked = acked;
+    cc_ack.in_flight   = ctx->snd_max - ctx->snd_una;
+    cc_ack.rtt         = rtt_ack(ctx, ack, opts);
+    cc_ack.srtt        = ctx->srtt;
+    cc_ack.now         = current_time();
+    ctx->cc.ops->on_ack(&ctx->cc, &cc_ack);
+    if (ctx->cm && !ctx->cc.in_recovery)
+        stcp_cm_ack(ctx->cm, acked, cc_ack.in_flight);
+
+    ring_consume(&ctx->send_ring, data_acked);
+    ctx->snd_una = ack;
+    blocks_trim(&ctx->scoreboard, ack);
+    if (SEQ_LT(ctx->snd_nxt, ack))
+        ctx->snd_nxt = ack;     /* acked beyond a go-back-N rewind */
+    ctx->dupacks = 0;
+
+    /* the ACK for a probe that resent data, unless the data turns
+     * out to have been lost along with more, means the probe repaired
+     * a loss on its own (RFC 8985, section 7.4).  without D-SACKs to
+     * say the original got through after all, that has to be
+     * assumed, and congestion control told.
+     */
+    if (ctx->tlp_active && SEQ_GEQ(ack, ctx->tlp_end))
+    {
+        ctx->tlp_active = FALSE;
+        if (ctx->tlp_resent && !ctx->cc.in_recovery)
+        {
+            dprintf("tail loss probe repaired a loss at %u\n",
+                    ctx->tlp_end);
+            enter_recovery(ctx);
+        }
+    }
+
+    rack_ack(sd, ctx);
+    if (ctx->done)
+        return;
+
+    /* a partial ACK during recovery means the next segment was lost
+     * too; resend it now rather than waiting for the timer (RFC 6582),
+     * unless that's already been done.
+     */
+    if (ctx->cc.in_recovery && !xmit_resent(ctx, ctx->snd_una))
+        retransmit_head(sd, ctx);
+
+    /* new data acknowledged; restart the timer for whatever is left.
+     * the peer is evidently still there, so the backoff is dropped
+     * even if rtt_ack() couldn't take a sample from this ACK.
+     */
+    ctx->retransmits = 0;
+    if (ctx->snd_una != ctx->snd_max)
+        arm_rto(ctx);
+    else
+        stcp_timer_cancel(&ctx->timers, &ctx->rto_timer);
+    arm_tlp(ctx);
+
+    if (fin_acked)
+    {
+        switch (ctx->connection_state)
+        {
+        case CSTATE_FIN_WAIT_1:
+            ctx->connection_state = CSTATE_FIN_WAIT_2;
+            break;
+
+        case CSTATE_CLOSING:
+        case CSTATE_LAST_ACK:
+            ctx->done = TRUE;
+            break;
+
+        default:
+            assert(0);
+            break;
+        }
+    }
+}
+
+/* a duplicate ACK arrived.  the third in a row (or more, if reordering
+ * has been seen) means the segment at snd_una was probably lost (later
+ * ones are getting through), so resend it and enter fast recovery.
+ * during recovery, each further duplicate lets congestion control open
+ * the window for another new segment.
+ */
+static void duplicate_ack(mysocket_t sd, context_t *ctx, tcp_seq ack)
+{
+    assert(ctx);
+
+    ++ctx->dupacks;
+    if (ctx->undo_active)
+        ctx->undo_dupacks = MAX(ctx->undo_dupacks, ctx->dupacks);
+
+    if (ctx->cc.in_recovery)
+    {
+        stcp_cc_ack_t cc_ack;
+
+        cc_ack.ack         = ack;
+        cc_ack.bytes_acked = 0;
+        cc_ack.in_flight   = ctx->snd_max - ctx->snd_una;
+        cc_ack.rtt         = 0;
+        cc_ack.srtt        = ctx->srtt;
+        cc_ack.now         = current_time();
+        ctx->cc.ops->on_ack(&ctx->cc, &cc_ack);
+        return;
+    }
+
+    /* duplicates of data sent before the last loss was dealt with don't
+     * signal a new loss (RFC 6582, section 3.2)
+     */
+    if (ctx->dupacks == ctx->dupthresh && SEQ_GT(ack, ctx->recover))
+    {
+        dprintf("fast retransmit at %u\n", ack);
+        enter_recovery(ctx);
+        retransmit_head(sd, ctx);
+    }
+}
+
+/* a loss was detected other than by the retransmission timer.  congestion
+ * control enters fast recovery, until everything now outstanding has been
+ * acknowledged; until then, duplicate ACKs don't signal a new loss.  the
+ * window is inflated by the duplicate ACKs seen so far, which there may be
+ * more or fewer of than usual if RACK or TLP found the loss.
+ */
+static void enter_recovery(context_t *ctx)
+{
+    assert(ctx);
+
+    undo_begin(ctx, FALSE);
+    ctx->recover = ctx->ecn_recover = ctx->snd_max;
+    ctx->cc.ops->on_loss(&ctx->cc, ctx->snd_max - ctx->snd_una,
+                         ctx->dupacks, ctx->recover, current_time());
+    if (ctx->cm)
+        ctx->undo_cm_cut += stcp_cm_congestion(ctx->cm);
+    stcp_timer_cancel(&ctx->timers, &ctx->tlp_timer);
+
+    if (++ctx->rack_reo_clean >= RACK_REO_RECOVERIES)
+    {
+        ctx->rack_reo_mult = 1;
+        ctx->rack_reo_clean = 0;
+    }
+}
+
+/* the peer echoed a congestion mark.  unless the window has been reduced
+ * already for what was outstanding when the mark was made, reduce it now,
+ * and say so with CWR on the next new data (RFC 3168, section 6.1.2).
+ * nothing was lost, so nothing is resent.
+ */
+static void ecn_echoed(context_t *ctx, tcp_seq ack)
+{
+    assert(ctx);
+
+    if (ctx->cc.in_recovery || !SEQ_GT(ack, ctx->ecn_recover))
+        return;
+
+    dprintf("congestion mark echoed at %u\n", ack);
+    ctx->ecn_recover = ctx->snd_max;
+    ctx->cwr_pending = TRUE;
+    if (ctx->cc.ops->on_ecn)
+    {
+        ctx->cc.ops->on_ecn(&ctx->cc, ctx->snd_max - ctx->snd_una,
+                            current_time());
+    }
+    if (ctx->cm)
+        (void) stcp_cm_congestion(ctx->cm);
+}
+
+/* a loss response is beginning (or a probe is resending data, which may
+ * lead to one): remember the window, in case the retransmissions turn
+ * out to have been needless.  one that's still under way, with what was
+ * outstanding when it began not yet all acknowledged, carries on with
+ * what it remembered.
+ */
+static void undo_begin(context_t *ctx, bool_t rto)
+{
+    assert(ctx);
+
+    if (ctx->undo_active && !SEQ_GT(ctx->snd_una, ctx->undo_recover))
+    {
+        ctx->undo_rto = ctx->undo_rto || rto;
+        return;
+    }
+
+    /* a peer that rebuilds lost data from our parity would report its
+     * retransmission as a duplicate, and echo the parity's timestamp,
+     * when the loss was real enough
+     */
+    ctx->undo_active   = (ctx->fec_group == 0);
+    ctx->undo_rto      = rto;
+    ctx->undo_marker   = ctx->snd_una;
+    ctx->undo_recover  = ctx->snd_max;
+    ctx->undo_cwnd     = stcp_cc_cwnd(&ctx->cc);
+    ctx->undo_ssthresh = stcp_cc_ssthresh(&ctx->cc);
+    ctx->undo_resent.n = 0;
+    ctx->undo_retrans  = 0;
+    ctx->undo_timed    = FALSE;
+    ctx->undo_dupacks  = ctx->dupacks;
+    ctx->undo_cm_cut   = 0;
+}
+
+/* len bytes at seq are being resent, with options opts, while the
+ * response may yet be undone.  Eifel can only judge a resend of snd_una,
+ * the first thing resent: the ACK that covers it echoes the timestamp of
+ * whichever copy arrived first.
+ */
+static void undo_resend(context_t *ctx, tcp_seq seq, uint32_t len,
+                        const stcp_opts_t *opts)
+{
+    assert(ctx && ctx->undo_active && opts);
+
+    if (ctx->undo_retrans == 0 && seq == ctx->undo_marker)
+    {
+        ctx->undo_timed = opts->ts_present;
+        ctx->undo_tsval = opts->ts_val;
+    }
+
+    if (!blocks_add(&ctx->undo_resent, seq, seq + len))
+    {
+        ctx->undo_active = FALSE;   /* too scattered to keep track of */
+        return;
+    }
+    ctx->undo_retrans += len;
+}
+
+/* the first ACK to cover the resent snd_una arrived.  if it echoes a
+ * timestamp from before the resend, the original got there first, and
+ * the resend was needless (RFC 3522).
+ */
+static void undo_eifel(mysocket_t sd, context_t *ctx,
+                       const stcp_opts_t *opts)
+{
+    assert(ctx && opts);
+
+    ctx->undo_timed = FALSE;
+    if (ctx->undo_active && opts->ts_ecr_valid &&
+        (int32_t) (opts->ts_ecr - ctx->undo_tsval) < 0)
+    {
+        dprintf("Eifel: resend of %u was spurious\n", ctx->undo_marker);
+        undo(sd, ctx);
+    }
+}
+
+/* the peer reported [start, end) as a duplicate.  once that's been said
+ * of everything resent, the originals must all have got through, and the
+ * response was needless (RFC 3708).
+ */
+static void undo_dsack(mysocket_t sd, context_t *ctx,
+                       tcp_seq start, tcp_seq end)
+{
+    const seq_blocks_t *b = &ctx->undo_resent;
+    uint32_t dup = 0;
+    unsigned int k;
+
+    assert(ctx);
+
+    if (!ctx->undo_active || ctx->undo_retrans == 0)
+        return;
+
+    for (k = 0; k < b->n; ++k)
+    {
+        tcp_seq s = SEQ_GT(start, b->blocks[k].start) ? start
+                                                      : b->blocks[k].start;
+        tcp_seq e = SEQ_LT(end, b->blocks[k].end) ? end : b->blocks[k].end;
+
+        if (SEQ_LT(s, e))
+            dup += e - s;
+    }
+
+    ctx->undo_retrans -= MIN(dup, ctx->undo_retrans);
+    if (dup > 0 && ctx->undo_retrans == 0)
+    {
+        dprintf("D-SACK: resends from %u were spurious\n", ctx->undo_marker);
+        undo(sd, ctx);
+    }
+}
+
+/* the current loss response was needless: put the window back, and go on
+ * sending new data.  unless it was the retransmission timer that jumped
+ * the gun, the data was reordered, so allow for more of that from now on.
+ */
+static void undo(mysocket_t sd, context_t *ctx)
+{
+    assert(ctx && ctx->undo_active);
+
+    ctx->undo_active = FALSE;
+    stcp_cc_undo(&ctx->cc, ctx->undo_cwnd, ctx->undo_ssthresh);
+    if (ctx->cm)
+        stcp_cm_undo(ctx->cm, ctx->undo_cm_cut);
+    if (SEQ_LT(ctx->snd_nxt, ctx->snd_max))
+        ctx->snd_nxt = ctx->snd_max;    /* the rest got there too */
+
+    if (!ctx->undo_rto)
+    {
+        ctx->dupthresh = MIN(MAX(ctx->dupthresh + 1, ctx->undo_dupacks + 1),
+                             DUPACK_THRESHOLD_MAX);
+        ++ctx->rack_reo_mult;
+        ctx->rack_reo_clean = 0;
+    }
+
+    dprintf("undo: cwnd %u, dupthresh %u, reordering window x%u\n",
+            stcp_cc_cwnd(&ctx->cc), ctx->dupthresh, ctx->rack_reo_mult);
+}
+
+/* resend the segment at snd_una straight away, without rewinding snd_nxt */
+static void retransmit_head(mysocket_t sd, context_t *ctx)
+{
+    assert(ctx);
+    retransmit_range(sd, ctx, ctx->snd_una, ctx->snd_una + ctx->mss);
+}
+
+/* resend whatever the peer hasn't SACKed of [start, end), as far as it's
+ * been sent, in segments of up to mss bytes.  snd_nxt isn't touched.
+ */
+static void retransmit_range(mysocket_t sd, context_t *ctx,
+                             tcp_seq start, tcp_seq end)
+{
+    tcp_seq data_end = ctx->send_ring.start + ctx->send_ring.len;
+    tcp_seq seq = SEQ_LT(start, ctx->snd_una) ? ctx->snd_una : start;
+
+    assert(ctx);
+
+    if (SEQ_GT(end, ctx->snd_max))
+        end = ctx->snd_max;
+
+    while (SEQ_LT(seq, end) && !ctx->done)
+    {
+        uint32_t len = ctx->mss;
+        uint8_t flags = TH_ACK;
+
+        seq = sack_skip(&ctx->scoreboard, seq, &len);
+        if (SEQ_GEQ(seq, end))
+            break;
+        len = MIN(len, end - seq);
+        len = MIN(len, data_end - seq);
+
+        /* if that's the last of the data, the FIN was sent with it */
+        if (ctx->fin_pending && seq + len == data_end &&
+            SEQ_GT(ctx->snd_max, data_end))
+        {
+            flags |= TH_FIN;
+        }
+
+        if (len == 0 && !(flags & TH_FIN))
+            break;
+
+        /* Karn's rule: the ACK for this can't be timed */
+        if (ctx->rtt_timing &&
+            SEQ_LT(ctx->rtt_seq, seq + len + ((flags & TH_FIN) ? 1 : 0)))
+        {
+            ctx->rtt_timing = FALSE;
+        }
+
+        send_segment(sd, ctx, seq, flags, len);
+        seq += len + ((flags & TH_FIN) ? 1 : 0);
+    }
+}
+
+/* send as much buffered data (and FIN, once the application has closed) as
+ * the peer's window permits.
+ */
+static void transport_output(mysocket_t sd, context_t *ctx)
+{
+    tcp_seq old_max = ctx->snd_max;
+
+    assert(ctx);
+
+    switch (ctx->connection_state)
+    {
+    case CSTATE_ESTABLISHED:
+    case CSTATE_CLOSE_WAIT:
+    case CSTATE_FIN_WAIT_1:
+    case CSTATE_CLOSING:
+    case CSTATE_LAST_ACK:
+        break;
+
+    default:
+        return;
+    }
+
+    stcp_timer_cancel(&ctx->timers, &ctx->pace_timer);
+    while (!ctx->done)
+    {
+        tcp_seq data_end = ctx->send_ring.start + ctx->send_ring.len;
+        tcp_seq wnd_end = ctx->snd_una + MIN(ctx->snd_wnd, send_cwnd(ctx));
+        uint32_t avail = 0, usable = 0, len, unsacked = ctx->mss;
+        uint8_t flags = TH_ACK;
+
+        /* when resending, skip whatever the peer already holds */
+        if (SEQ_LT(ctx->snd_nxt, ctx->snd_max))
+            ctx->snd_nxt = sack_skip(&ctx->scoreboard, ctx->snd_nxt,
+                                     &unsacked);
+
+        if (SEQ_LT(ctx->snd_nxt, data_end))
+            avail = data_end - ctx->snd_nxt;
+        if (SEQ_LT(ctx->snd_nxt, wnd_end))
+            usable = wnd_end - ctx->snd_nxt;
+
+        len = MIN(MIN(avail, usable), MIN(unsacked, ctx->mss));
+
+        /* the FIN rides on the segment carrying the last of the data, or
+         * goes on its own once that's out.
+         */
+        if (ctx->fin_pending && len == avail &&
+            SEQ_LEQ(ctx->snd_nxt, data_end))
+        {
+            flags |= TH_FIN;
+        }
+
+        if (len == 0 && !(flags & TH_FIN))
+            break;
+
+        if (len == avail && !(flags & TH_FIN) &&
+            hold_partial_segment(ctx, len))
+        {
+            break;
+        }
+
+        if (len > 0 && !pacing_allows(ctx, len))
+            break;
+
+        send_segment(sd, ctx, ctx->snd_nxt, flags, len);
+        ctx->snd_nxt += len + ((flags & TH_FIN) ? 1 : 0);
+        if (SEQ_GT(ctx->snd_nxt, ctx->snd_max))
+            ctx->snd_max = ctx->snd_nxt;
+        if (len < ctx->mss && SEQ_GT(ctx->snd_nxt, ctx->snd_small))
+            ctx->snd_small = ctx->snd_nxt;
+        stcp_timer_cancel(&ctx->timers, &ctx->cork_timer);
+
+        if (!stcp_timer_pending(&ctx->rto_timer))
+            arm_rto(ctx);
+    }
+
+    if (ctx->snd_max != old_max)
+        arm_tlp(ctx);
+
+    /* the data has paused, so don't leave the end of it unprotected
+     * waiting for the group to fill
+     */
+    if (ctx->fec_count > 0 &&
+        SEQ_GEQ(ctx->snd_max, ctx->send_ring.start + ctx->send_ring.len))
+    {
+        fec_flush(sd, ctx);
+    }
+
+    /* data is waiting on a shut window, and with nothing in flight, only
+     * the peer's window update will open it.  if that's lost, the persist
+     * timer finds out.
+     */
+    if (ctx->snd_wnd == 0 && ctx->snd_una == ctx->snd_max &&
+        SEQ_LT(ctx->snd_max, ctx->send_ring.start + ctx->send_ring.len))
+    {
+        if (!stcp_timer_pending(&ctx->persist_timer))
+            arm_persist(ctx);
+    }
+    else
+    {
+        stcp_timer_cancel(&ctx->timers, &ctx->persist_timer);
+        ctx->persists = 0;
+    }
+}
+
+/* the retransmission timer expired; back off, and resend from the oldest
+ * unacknowledged sequence number.
+ */
+static void retransmit_timeout(mysocket_t sd, context_t *ctx)
+{
+    assert(ctx);
+
+    if (++ctx->retransmits > MAX_RETRANSMITS)
+    {
+        dprintf("giving up after %u retransmissions\n", ctx->retransmits);
+        abort_connection(ctx, ETIMEDOUT);
+        return;
+    }
+
+    arm_rto(ctx);
+    ctx->rtt_timing = FALSE;    /* Karn's rule */
+
+    switch (ctx->connection_state)
+    {
+    case CSTATE_SYN_SENT:
+        send_segment(sd, ctx, ctx->initial_sequence_num, TH_SYN, 0);
+        break;
+
+    case CSTATE_SYN_RCVD:
+        send_segment(sd, ctx, ctx->initial_sequence_num,
+                     TH_SYN | TH_ACK, 0);
+        break;
+
+    default:
+        /* the first expiry tells congestion control about the loss;
+         * repeated expiries for the same data leave cwnd at its minimum.
+         * then go back N: transport_output() resends from snd_una, as
+         * fast as cwnd lets it.
+         */
+        if (ctx->retransmits == 1)
+        {
+            undo_begin(ctx, TRUE);
+            ctx->cc.ops->on_timeout(&ctx->cc, ctx->snd_max - ctx->snd_una,
+                                    current_time());
+            if (ctx->cm)
+                ctx->undo_cm_cut += stcp_cm_congestion(ctx->cm);
+        }
+
+        /* don't take duplicate ACKs (or congestion marks) for what's
+         * resent as a new loss
+         */
+        ctx->recover = ctx->ecn_recover = ctx->snd_max;
+        ctx->dupacks = 0;
+
+        /* SACKed data is skipped on the way, unless the timer has gone
+         * off repeatedly; then the peer may have discarded what it
+         * SACKed (RFC 2018, section 8), so resend everything.
+         */
+        if (ctx->retransmits > 1)
+            ctx->scoreboard.n = 0;
+        ctx->snd_nxt = ctx->snd_una;
+
+        /* everything outstanding is as good as lost, and is about to be
+         * resent (and logged) again; that's all RACK would have done
+         */
+        ctx->xmit_n = ctx->xmit_resent = 0;
+        ctx->tlp_active = FALSE;
+        stcp_timer_cancel(&ctx->timers, &ctx->rack_timer);
+        stcp_timer_cancel(&ctx->timers, &ctx->tlp_timer);
+        break;
+    }
+}
+
+/* build and send a segment starting at sequence number seq, carrying
+ * data_len bytes from the send ring.
+ */
+static void send_segment(mysocket_t sd, context_t *ctx, tcp_seq seq,
+                         uint8_t flags, uint32_t data_len)
+{
+    char *segment = ctx->send_buf;
+    STCPHeader *hdr = (STCPHeader *) segment;
+    stcp_opts_t opts;
+    size_t hdr_len, opt_room;
+
+    assert(ctx);
+    assert(data_len <= ctx->mss);
+
+    /* a SYN offers SACK (or, on a SYN-ACK, accepts it); once it's agreed,
+     * ACKs report any out-of-order data we're holding.  timestamps go on
+     * everything, SYN included, once offered.  any peer may send us
+     * parity.
+     */
+    memset(&opts, 0, sizeof(opts));
+    if (ctx->ts_enabled)
+    {
+        opts.ts_present = TRUE;
+        opts.ts_val = (uint32_t) current_time();
+        opts.ts_ecr = ctx->ts_recent;
+    }
+
+    if (flags & TH_SYN)
+    {
+        opts.mss = ctx->rcv_mss;
+        opts.sack_permitted = ctx->sack_enabled;
+        opts.fec_permitted = TRUE;
+        opts.wscale_present = ctx->wscale_enabled;
+        opts.wscale = ctx->rcv_wscale;
+    }
+    else if ((flags & TH_ACK) && ctx->sack_enabled &&
+             (ctx->reass.n > 0 || ctx->dsack_pending))
+    {
+        opts.num_sack = reass_sack_blocks(ctx, opts.sack, MAX_SACK_BLOCKS);
+        ctx->dsack_pending = FALSE;
+    }
+
+    /* options and data together mustn't exceed the peer's MSS; SACK
+     * blocks are what give way
+     */
+    opt_room = MIN(MAX_TCP_OPTIONS_LEN, ctx->snd_mss - data_len);
+
+    memset(hdr, 0, sizeof(*hdr));
+    hdr_len = sizeof(*hdr) +
+        stcp_opt_build(segment + sizeof(*hdr), opt_room, &opts);
+
+    /* with ECN, a SYN asks for it, and a SYN-ACK agrees (RFC 3168,
+     * section 6.1.1).  after that, ACKs echo marks, and new data, but not
+     * retransmissions or anything else, may be marked instead of dropped.
+     */
+    if (ctx->ecn_enabled)
+    {
+        if (flags & TH_SYN)
+            flags |= (flags & TH_ACK) ? TH_ECE : (TH_ECE | TH_CWR);
+        else if ((flags & TH_ACK) && ctx->ece_pending)
+            flags |= TH_ECE;
+
+        if (data_len > 0 && seq == ctx->snd_max && !(flags & TH_SYN))
+        {
+            hdr->th_x2 = TH_X2_ECT;
+            if (ctx->cwr_pending)
+            {
+                flags |= TH_CWR;
+                ctx->cwr_pending = FALSE;
+            }
+        }
+    }
+
+    hdr->th_seq   = htonl(seq);
+    hdr->th_off   = hdr_len / sizeof(uint32_t);
+    hdr->th_flags = flags;
+    hdr->th_win   = htons(advertise_window(sd, ctx, flags));
+
+    if (flags & TH_ACK)
+    {
+        hdr->th_ack = htonl(ctx->rcv_nxt);
+        ctx->last_ack_sent = ctx->rcv_nxt;
+
+        /* this settles any ACK we owed */
+        ctx->ack_now = FALSE;
+        ctx->ack_bytes = 0;
+        stcp_timer_cancel(&ctx->timers, &ctx->delack_timer);
+    }
+
+    if (data_len > 0)
+        ring_copy_out(&ctx->send_ring, seq, segment + hdr_len, data_len);
+
+    /* time this segment if it's new and nothing else is being timed */
+    if (!ctx->rtt_timing && seq == ctx->snd_max &&
+        (data_len > 0 || (flags & (TH_SYN | TH_FIN))))
+    {
+        ctx->rtt_timing = TRUE;
+        ctx->rtt_seq = seq;
+        ctx->rtt_start = current_time();
+    }
+
+    if ((data_len > 0 || (flags & TH_FIN)) && !(flags & TH_SYN))
+        xmit_log(ctx, seq, seq + data_len + ((flags & TH_FIN) ? 1 : 0));
+
+    if (ctx->undo_active && data_len > 0 && SEQ_LT(seq, ctx->snd_max))
+        undo_resend(ctx, seq, data_len, &opts);
+
+    if (flags & TH_SYN)
+    {
+        /* the handshake is covered by the retransmission timer too */
+        if (SEQ_LEQ(ctx->snd_max, seq))
+            ctx->snd_nxt = ctx->snd_max = seq + 1;
+        if (!stcp_timer_pending(&ctx->rto_timer))
+            arm_rto(ctx);
+    }
+
+    if (stcp_network_send(sd, segment, hdr_len + data_len, NULL) < 0)
+    {
+        /* the network layer reports failure only if the peer can't be
+         * reached at all (e.g. its end of the connection is gone).
+         */
+        abort_connection(ctx, (ctx->connection_state == CSTATE_SYN_SENT)
+                         ? ECONNREFUSED : ECONNRESET);
+        return;
+    }
+
+    /* new data joins the group the next parity segment covers */
+    if (ctx->fec_group && data_len > 0 && seq == ctx->snd_max)
+    {
+        fec_add(sd, ctx, seq, segment + hdr_len, data_len,
+                (flags & TH_FIN) != 0);
+    }
+}
+
+/* called when ack advances snd_una.  if it echoes one of our timestamps,
+ * or covers the segment being timed, fold the measurement into the
+ * smoothed RTT and recompute the retransmission timeout (RFC 6298).  a
+ * timestamp is good even if the data was retransmitted, since it says
+ * which transmission is being acknowledged.  returns the RTT sample (us),
+ * or 0 if the ACK didn't yield one.
+ */
+static uint32_t rtt_ack(context_t *ctx, tcp_seq ack,
+                        const stcp_opts_t *opts)
+{
+    uint32_t sample;
+
+    assert(ctx && opts);
+
+    if (ctx->ts_enabled && opts->ts_ecr_valid)
+    {
+        sample = (uint32_t) current_time() - opts->ts_ecr;
+        if ((int32_t) sample < 0)
+            return 0;   /* not a time we sent */
+    }
+    else if (ctx->rtt_timing && SEQ_GT(ack, ctx->rtt_seq))
+    {
+        sample = (uint32_t) (current_time() - ctx->rtt_start);
+    }
+    else
+    {
+        return 0;
+    }
+
+    ctx->rtt_timing = FALSE;
+    if (!ctx->min_rtt || sample < ctx->min_rtt)
+        ctx->min_rtt = MAX(sample, 1);
+
+    if (ctx->cm)
+    {
+        stcp_cm_rtt_sample(ctx->cm, sample, &ctx->srtt, &ctx->rttvar);
+    }
+    else if (!ctx->srtt)
+    {
+        ctx->srtt = MAX(sample, 1);
+        ctx->rttvar = sample / 2;
+    }
+    else
+    {
+        uint32_t delta = (sample > ctx->srtt)
+            ? sample - ctx->srtt : ctx->srtt - sample;
+
+        ctx->rttvar = (3 * ctx->rttvar + delta) / 4;
+        ctx->srtt = MAX((7 * ctx->srtt + sample) / 8, 1);
+    }
+
+    ctx->rto = ctx->srtt + MAX(RTO_GRANULARITY, 4 * ctx->rttvar);
+    ctx->rto = MIN(MAX(ctx->rto, RTO_MIN), RTO_MAX);
+    dprintf("rtt sample %u us: srtt=%u rttvar=%u rto=%u\n",
+            sample, ctx->srtt, ctx->rttvar, ctx->rto);
+    return MAX(sample, 1);
+}
+
+/* (re)start the retransmission timer */
+static void arm_rto(context_t *ctx)
+{
+    assert(ctx);
+    stcp_timer_arm(&ctx->timers, &ctx->rto_timer,
+                   current_time() + current_rto(ctx, ctx->retransmits));
+}
+
+/* the estimated RTO, doubled backoff times: for the retransmission
+ * timer, once for each consecutive expiry without forward progress
+ */
+static uint32_t current_rto(const context_t *ctx, unsigned int backoff)
+{
+    assert(ctx);
+
+    if (backoff >= 16 || (ctx->rto << backoff) > RTO_MAX)
+        return RTO_MAX;
+    return ctx->rto << backoff;
+}
+
+/* (re)start the persist timer, backing off like the retransmission timer
+ * for each probe that finds the window still shut.  unlike the
+ * retransmission timer, it never gives up: the peer is answering.
+ */
+static void arm_persist(context_t *ctx)
+{
+    assert(ctx);
+    stcp_timer_arm(&ctx->timers, &ctx->persist_timer,
+                   current_time() + current_rto(ctx, ctx->persists));
+}
+
+/* the persist timer expired with the peer's window still shut.  the
+ * window update that would open it may have been lost, so ask again: a
+ * bare ACK from just before snd_una is outside the peer's window, and
+ * is answered with an ACK carrying its current one.
+ */
+static void persist_probe(mysocket_t sd, context_t *ctx)
+{
+    assert(ctx);
+
+    dprintf("probing zero window at %u\n", ctx->snd_una);
+    send_segment(sd, ctx, ctx->snd_una - 1, TH_ACK, 0);
+    ++ctx->persists;
+    arm_persist(ctx);
+}
+
+/* the window we can offer the peer: room for whatever the application
+ * hasn't read yet.  to avoid silly window syndrome (RFC 1122, section
+ * 4.2.3.3) it only opens by a full segment, or half the buffer, at a
+ * time.  it never shrinks, either; the data beyond rcv_nxt that the peer
+ * has already been allowed is still accepted.  while there's a gap in the
+ * data, it doesn't open at all: the peer only counts our ACKs as
+ * duplicates, for fast retransmit, if their windows are the same.
+ */
+static uint32_t receive_window(mysocket_t sd, const context_t *ctx)
+{
+    uint32_t adv = 0, space = 0;
+    size_t unread;
+
+    assert(ctx);
+
+    if (SEQ_GT(ctx->rcv_adv, ctx->rcv_nxt))
+        adv = ctx->rcv_adv - ctx->rcv_nxt;
+    if ((unread = stcp_app_unread(sd)) < ctx->rcv_buf)
+        space = ctx->rcv_buf - unread;
+
+    if (ctx->reass.n > 0 || space < adv + MIN(ctx->rcv_buf / 2, ctx->mss))
+        return adv;
+    return space;
+}
+
+/* returns th_win for an outgoing segment, and moves rcv_adv up to the
+ * right edge of the window it gives.  a SYN's window is never scaled.
+ * otherwise, scaling may round the window down a little; rcv_adv isn't
+ * moved back, so that doesn't shrink what we accept.
+ */
+static uint16_t advertise_window(mysocket_t sd, context_t *ctx,
+                                 uint8_t flags)
+{
+    uint32_t wnd = receive_window(sd, ctx), win;
+    tcp_seq edge;
+
+    assert(ctx);
+
+    if (flags & TH_SYN)
+    {
+        win = MIN(wnd, TCP_MAXWIN);
+        edge = ctx->rcv_nxt + win;
+    }
+    else
+    {
+        win = MIN(wnd >> ctx->rcv_wscale, TCP_MAXWIN);
+        edge = ctx->rcv_nxt + (win << ctx->rcv_wscale);
+    }
+
+    if (SEQ_GT(edge, ctx->rcv_adv))
+        ctx->rcv_adv = edge;
+    return (uint16_t) win;
+}
+
+/* returns TRUE if the application has read enough to open the window by
+ * two segments, or half the buffer, since it was last advertised; that's
+ * worth an ACK of its own (RFC 1122, section 4.2.3.3).
+ */
+static bool_t window_update_due(mysocket_t sd, const context_t *ctx)
+{
+    uint32_t adv = 0;
+
+    assert(ctx);
+
+    if (SEQ_GT(ctx->rcv_adv, ctx->rcv_nxt))
+        adv = ctx->rcv_adv - ctx->rcv_nxt;
+    return receive_window(sd, ctx) >=
+           adv + MIN(2 * ctx->mss, ctx->rcv_buf / 2);
+}
+
+/* called when data arrives in order, to take an RTT sample for tuning
+ * the receive buffer.  the first segment to echo one of our timestamps
+ * was sent on the ACK carrying it, so gives a sample much like the
+ * sender's.  without timestamps, the time the peer takes to reach the
+ * edge of a window is at least an RTT, so the least such sample is kept.
+ */
+static void rcv_rtt_measure(context_t *ctx, const stcp_opts_t *opts)
+{
+    uint64_t now = current_time();
+    uint32_t sample;
+
+    assert(ctx && opts);
+
+    if (ctx->ts_enabled && opts->ts_ecr_valid)
+    {
+        if (opts->ts_ecr == ctx->rcv_rtt_tsecr)
+            return;
+        ctx->rcv_rtt_tsecr = opts->ts_ecr;
+
+        sample = (uint32_t) now - opts->ts_ecr;
+        if ((int32_t) sample <= 0)
+            return;     /* not a time we sent */
+        ctx->rcv_rtt = ctx->rcv_rtt ? (7 * ctx->rcv_rtt + sample) / 8
+                                    : sample;
+    }
+    else if (!ctx->rcv_rtt_start || SEQ_GEQ(ctx->rcv_nxt, ctx->rcv_rtt_seq))
+    {
+        if (ctx->rcv_rtt_start)
+        {
+            sample = (uint32_t) MAX(now - ctx->rcv_rtt_start, 1);
+            if (!ctx->rcv_rtt || sample < ctx->rcv_rtt)
+                ctx->rcv_rtt = sample;
+        }
+        ctx->rcv_rtt_seq = ctx->rcv_adv;
+        ctx->rcv_rtt_start = now;
+    }
+}
+
+/* called when data arrives in order, to size the receive buffer for the
+ * rate the application is reading at.  each round trip, if more was read
+ * than in any round trip before, the buffer grows to twice that, with
+ * some slack for the peer's bursts; by more again while the rate is
+ * still climbing, so it keeps ahead of a sender in slow start.  after the
+ * connection has been idle, the buffer is halved for each RTO it sat
+ * unused (much as RFC 2861 decays an idle sender's cwnd), down to the
+ * initial size, and has to earn its growth again.  a pause ended by data
+ * filling a gap (gap is TRUE) was the peer recovering from a loss, not
+ * idling.  any window the peer has already been offered stands.
+ */
+static void rcvbuf_adjust(mysocket_t sd, context_t *ctx, bool_t gap)
+{
+    uint64_t now = current_time(), idle, target;
+    uint32_t rtt, copied, floor;
+    tcp_seq read;
+
+    assert(ctx);
+
+    floor = MIN(RECEIVE_WINDOW_INITIAL, ctx->rcv_buf_max);
+    idle = ctx->rcv_last ? now - ctx->rcv_last : 0;
+    ctx->rcv_last = now;
+    read = ctx->rcv_nxt - (tcp_seq) stcp_app_unread(sd);
+
+    if (idle >= ctx->rto && !gap)
+    {
+        for (; idle >= ctx->rto && ctx->rcv_buf > floor; idle -= ctx->rto)
+            ctx->rcv_buf = MAX(ctx->rcv_buf / 2, floor);
+        dprintf("receive buffer idle, shrunk to %u\n", ctx->rcv_buf);
+        ctx->rcv_space = 0;
+        ctx->rcv_space_start = 0;
+    }
+
+    rtt = ctx->rcv_rtt ? ctx->rcv_rtt : ctx->srtt;
+    if (ctx->rcv_space_start &&
+        (!rtt || now - ctx->rcv_space_start < rtt))
+    {
+        return;
+    }
+
+    if (ctx->rcv_space_start &&
+        (copied = read - ctx->rcv_space_seq) > ctx->rcv_space)
+    {
+        target = 2 * (uint64_t) copied +
+                 RECEIVE_SLACK_SEGMENTS * (uint64_t) ctx->mss;
+        if (ctx->rcv_space)
+        {
+            target += 2 * target * (copied - ctx->rcv_space) /
+                      ctx->rcv_space;
+        }
+        ctx->rcv_space = copied;
+
+        if (target > ctx->rcv_buf && ctx->rcv_buf < ctx->rcv_buf_max)
+        {
+            ctx->rcv_buf = (uint32_t) MIN(target, ctx->rcv_buf_max);
+            dprintf("receive buffer grown to %u\n", ctx->rcv_buf);
+        }
+    }
+
+    ctx->rcv_space_seq = read;
+    ctx->rcv_space_start = now;
+}
+
+/* if the connection is paced, returns TRUE (and takes len bytes' worth
+ * of tokens) if a segment may be sent now; otherwise returns FALSE and
+ * leaves the control loop to wake up, to the microsecond, once there are
+ * enough.  the bucket only holds a burst's worth, so time spent idle
+ * doesn't build up into a longer burst later.
+ */
+static bool_t pacing_allows(context_t *ctx, uint32_t len)
+{
+    uint64_t rate, now, depth, need;
+
+    assert(ctx);
+
+    if (!(rate = pacing_rate(ctx)))
+        return TRUE;
+
+    now = current_time();
+    depth = MAX((uint64_t) PACING_BURST_SEGMENTS * ctx->mss,
+                rate * PACING_BURST_TIME / 1000000) * 1000000;
+    need = (uint64_t) len * 1000000;
+
+    /* the time since the last top-up is capped at a second, which fills
+     * the bucket at any rate and can't overflow
+     */
+    ctx->pace_tokens += rate * MIN(now - ctx->pace_stamp, 1000000);
+    ctx->pace_tokens = MIN(ctx->pace_tokens, MAX(depth, need));
+    ctx->pace_stamp = now;
+
+    if (ctx->pace_tokens < need)
+    {
+        stcp_timer_arm(&ctx->timers, &ctx->pace_timer,
+                       now + (need - ctx->pace_tokens + rate - 1) / rate);
+        return FALSE;
+    }
+
+    ctx->pace_tokens -= need;
+    return TRUE;
+}
+
+/* the congestion window to send by: the connection's own, but no more
+ * than its share of the group's, under the congestion manager
+ */
+static uint32_t send_cwnd(const context_t *ctx)
+{
+    uint32_t cwnd;
+
+    assert(ctx);
+
+    cwnd = stcp_cc_cwnd(&ctx->cc);
+    if (ctx->cm)
+    {
+        uint32_t share = stcp_cm_share(ctx->cm);
+
+        /* in fast recovery, cwnd is inflated for the segments that have
+         * left the network; the share has to be too, or the ACK clock
+         * stops until the timer goes off
+         */
+        if (ctx->cc.in_recovery)
+            share += cwnd - MIN(cwnd, stcp_cc_ssthresh(&ctx->cc));
+        cwnd = MIN(cwnd, share);
+    }
+    return cwnd;
+}
+
+/* the rate (bytes/s) to pace at, or 0 if segments may go out as fast as
+ * the window allows
+ */
+static uint64_t pacing_rate(const context_t *ctx)
+{
+    uint64_t rate = 0;
+    uint32_t cwnd;
+
+    assert(ctx);
+
+    if (ctx->cc.ops->pacing_rate)
+    {
+        rate = ctx->cc.ops->pacing_rate(&ctx->cc);
+    }
+    else if (ctx->pacing && ctx->srtt)
+    {
+        cwnd = send_cwnd(ctx);
+        rate = (uint64_t) cwnd * 1000000 / ctx->srtt *
+               ((cwnd < stcp_cc_ssthresh(&ctx->cc) / 2) ? PACING_SS_RATIO
+                                                         : PACING_CA_RATIO) /
+               100;
+    }
+
+    if (ctx->max_pacing_rate && (!rate || rate > ctx->max_pacing_rate))
+        rate = ctx->max_pacing_rate;
+    return rate;
+}
+
+/* new in-order data arrived, and ACKs may be delayed.  ACK every second
+ * full-sized segment straight away (RFC 5681, section 4.2); otherwise
+ * wait a little in case there's data to send the ACK with, or another
+ * segment to ACK along with this one.
+ */
+static void schedule_ack(context_t *ctx, uint32_t data_len)
+{
+    assert(ctx);
+
+    ctx->ack_bytes += data_len;
+    if (ctx->ack_bytes >= 2 * ctx->mss)
+        ctx->ack_now = TRUE;
+    else if (!stcp_timer_pending(&ctx->delack_timer))
+        stcp_timer_arm(&ctx->timers, &ctx->delack_timer,
+                       current_time() + DELACK_TIMEOUT);
+}
+
+/* returns TRUE if the last len bytes the application has written should
+ * wait for more to fill out the segment.  a corked connection waits (for
+ * up to CORK_TIMEOUT); otherwise Nagle's algorithm (RFC 896), in
+ * Minshall's form, waits only while an earlier partial segment is still
+ * unacknowledged.  retransmissions and flushed data are never held.
+ */
+static bool_t hold_partial_segment(context_t *ctx, uint32_t len)
+{
+    assert(ctx);
+
+    if (len >= ctx->mss || SEQ_LT(ctx->snd_nxt, ctx->snd_max) ||
+        SEQ_LT(ctx->snd_nxt, ctx->push_seq))
+    {
+        return FALSE;
+    }
+
+    if (ctx->corked)
+    {
+        if (!stcp_timer_pending(&ctx->cork_timer))
+        {
+            stcp_timer_arm(&ctx->timers, &ctx->cork_timer,
+                           current_time() + CORK_TIMEOUT);
+        }
+        return TRUE;
+    }
+
+    return !ctx->nodelay && SEQ_GT(ctx->snd_small, ctx->snd_una);
+}
+
+/* settle window scaling from the options on the peer's SYN or SYN-ACK.
+ * it's used only if both sides asked for it; otherwise our window has to
+ * fit in th_win as it is.
+ */
+static void negotiate_wscale(context_t *ctx, const stcp_opts_t *opts)
+{
+    assert(ctx && opts);
+
+    ctx->wscale_enabled = ctx->wscale_enabled && opts->wscale_present;
+    if (ctx->wscale_enabled)
+    {
+        ctx->snd_wscale = opts->wscale;
+    }
+    else
+    {
+        ctx->snd_wscale = ctx->rcv_wscale = 0;
+        ctx->rcv_buf_max = MIN(ctx->rcv_buf_max, TCP_MAXWIN);
+        ctx->rcv_buf = MIN(ctx->rcv_buf, ctx->rcv_buf_max);
+    }
+}
+
+/* settle timestamps from the options on the peer's SYN or SYN-ACK, and
+ * record the peer's first timestamp for echoing back.  they're used only
+ * if both sides asked for them.
+ */
+static void negotiate_timestamps(context_t *ctx, const stcp_opts_t *opts)
+{
+    assert(ctx && opts);
+
+    ctx->ts_enabled = ctx->ts_enabled && opts->ts_present;
+    if (ctx->ts_enabled)
+    {
+        ctx->ts_recent = opts->ts_val;
+        ctx->ts_recent_age = current_time();
+    }
+}
+
+/* settle forward error correction from the options on the peer's SYN or
+ * SYN-ACK.  we send parity only if the peer can use it; we offer to take
+ * it whatever MYSO_FEC says.
+ */
+static void negotiate_fec(context_t *ctx, const stcp_opts_t *opts)
+{
+    assert(ctx && opts);
+
+    if (!opts->fec_permitted)
+        ctx->fec_group = 0;
+    if (ctx->fec_group)
+    {
+        ctx->fec_parity = (char *) malloc(ctx->mtu);
+        assert(ctx->fec_parity);
+    }
+}
+
+/* settle ECN from the flags on the peer's SYN or SYN-ACK.  a SYN asking
+ * for it has both ECE and CWR set; a SYN-ACK agreeing has ECE alone.
+ */
+static void negotiate_ecn(context_t *ctx, const STCPHeader *hdr)
+{
+    uint8_t want = (hdr->th_flags & TH_ACK) ? TH_ECE : (TH_ECE | TH_CWR);
+
+    assert(ctx && hdr);
+    ctx->ecn_enabled = ctx->ecn_enabled &&
+                       (hdr->th_flags & (TH_ECE | TH_CWR)) == want;
+}
+
+/* settle the segment size from the MSS option on the peer's SYN or
+ * SYN-ACK (RFC 879's default if there isn't one), and set up congestion
+ * control for it.  this must follow negotiate_timestamps() and
+ * negotiate_fec(), since the timestamp on every segment comes out of the
+ * MSS, as does room for the FEC option on a parity segment the size of
+ * a full one.
+ */
+static void negotiate_mss(mysocket_t sd, context_t *ctx,
+                          const stcp_opts_t *opts)
+{
+    uint32_t peer_mss;
+
+    assert(ctx && opts);
+
+    peer_mss = opts->mss ? opts->mss : STCP_MSS;
+    ctx->snd_mss = MIN(MAX(peer_mss, MIN_MSS), ctx->rcv_mss);
+    ctx->mss = ctx->snd_mss - (ctx->ts_enabled ? TCPOLEN_TIMESTAMP_APPA : 0) -
+               (ctx->fec_group ? TCPOLEN_FEC_APPA : 0);
+
+    stcp_cc_init(&ctx->cc, stcp_get_option(sd, MYSO_CONGESTION), ctx->mss);
+    if (ctx->metrics.srtt)
+        stcp_cc_warm(&ctx->cc, ctx->metrics.cwnd, ctx->metrics.ssthresh);
+    if (!ctx->cm && stcp_get_option(sd, MYSO_CONGESTION_MANAGER))
+        ctx->cm = stcp_cm_join(ctx->peer_addr, ctx->mss);
+    dprintf("mss %u, congestion control: %s, cwnd %u\n", ctx->mss,
+            ctx->cc.ops->name, stcp_cc_cwnd(&ctx->cc));
+}
+
+/* PAWS (RFC 7323, section 5): a segment with a timestamp older than the
+ * last one recorded from the peer is an old duplicate, possibly from
+ * before the sequence space wrapped, even if its sequence number looks
+ * acceptable.  returns TRUE if the segment should be dropped.
+ */
+static bool_t paws_reject(const context_t *ctx, const stcp_opts_t *opts)
+{
+    assert(ctx && opts);
+
+    if (!ctx->ts_enabled || !opts->ts_present)
+        return FALSE;
+
+    /* timestamps compare modulo 2^32, like sequence numbers */
+    return SEQ_LT(opts->ts_val, ctx->ts_recent) &&
+           current_time() - ctx->ts_recent_age < PAWS_IDLE;
+}
+
+/* the smallest shift that lets th_win carry a window of wnd bytes */
+static unsigned int window_shift(uint32_t wnd)
+{
+    unsigned int shift = 0;
+
+    while (shift < TCP_MAX_WINSHIFT && (wnd >> shift) > TCP_MAXWIN)
+        ++shift;
+    return shift;
+}
+
+/* tear the connection down without the usual FIN exchange */
+static void abort_connection(context_t *ctx, int error)
+{
+    assert(ctx);
+
+    errno = error;
+    ctx->done = TRUE;
+}
+
+
+/* SACK scoreboard helpers */
+
+/* merge the SACK blocks from an ACK into the scoreboard.  anything outside
+ * (snd_una, snd_max] is ignored.  if the scoreboard fills up, the highest
+ * blocks are forgotten first; that data is just resent unnecessarily.
+ */
+static void sack_update(seq_blocks_t *sb, const stcp_opts_t *opts,
+                        tcp_seq snd_una, tcp_seq snd_max)
+{
+    unsigned int k;
+
+    assert(sb && opts);
+
+    for (k = 0; k < opts->num_sack; ++k)
+    {
+        tcp_seq start = opts->sack[k].start, end = opts->sack[k].end;
+
+        if (SEQ_LT(start, snd_una))
+            start = snd_una;
+        if (SEQ_GT(end, snd_max))
+            end = snd_max;
+        if (SEQ_GEQ(start, end))
+            continue;
+
+        while (!blocks_add(sb, start, end) &&
+               SEQ_LT(start, sb->blocks[sb->n - 1].start))
+        {
+            --sb->n;
+        }
+    }
+}
+
+/* returns the first sequence number at or after seq that the peer hasn't
+ * SACKed, and limits *len to the data from there that it hasn't SACKed
+ * either.
+ */
+static tcp_seq sack_skip(const seq_blocks_t *sb, tcp_seq seq,
+                         uint32_t *len)
+{
+    unsigned int k;
+
+    assert(sb && len);
+
+    for (k = 0; k < sb->n; ++k)
+    {
+        if (SEQ_LEQ(sb->blocks[k].end, seq))
+            continue;
+
+        if (SEQ_LEQ(sb->blocks[k].start, seq))
+        {
+            seq = sb->blocks[k].end;
+            continue;
+        }
+
+        *len = MIN(*len, sb->blocks[k].start - seq);
+        break;
+    }
+
+    return seq;
+}
+
+
+/* RACK-TLP helpers */
+
+/* log a segment as it's sent.  a retransmission makes the earlier
+ * transmissions it repeats stale: when the latest copy went out is what
+ * says whether the data is overdue.
+ */
+static void xmit_log(context_t *ctx, tcp_seq seq, tcp_seq end)
+{
+    bool_t resent = SEQ_LT(seq, ctx->snd_max);
+    xmit_t *x;
+    unsigned int k;
+
+    assert(ctx && SEQ_LT(seq, end));
+
+    for (k = 0; resent && k < ctx->xmit_n; ++k)
+    {
+        x = &XMIT_AT(ctx, k);
+        if (SEQ_LEQ(seq, x->start) && SEQ_LT(x->start, end))
+            x->flags |= XMIT_STALE;
+    }
+
+    if (ctx->xmit_n == XMIT_LOG_SIZE)
+        return;
+
+    x = &XMIT_AT(ctx, ctx->xmit_n);
+    ++ctx->xmit_n;
+    x->start = seq;
+    x->end   = end;
+    x->sent  = current_time();
+    x->flags = resent ? XMIT_RETRANSMIT : 0;
+    if (resent)
+        ++ctx->xmit_resent;
+}
+
+/* returns TRUE if the latest copy of seq sent was a retransmission that's
+ * still outstanding
+ */
+static bool_t xmit_resent(const context_t *ctx, tcp_seq seq)
+{
+    unsigned int k;
+
+    assert(ctx);
+
+    for (k = 0; ctx->xmit_resent > 0 && k < ctx->xmit_n; ++k)
+    {
+        const xmit_t *x = &XMIT_AT(ctx, k);
+
+        if (x->flags == XMIT_RETRANSMIT &&
+            SEQ_LEQ(x->start, seq) && SEQ_LT(seq, x->end))
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/* called for each ACK that advances snd_una or carries SACK blocks, once
+ * they've been taken into account.  the log is cleared of what's been
+ * acknowledged; if anything else might be overdue, it's checked for loss.
+ */
+static void rack_ack(mysocket_t sd, context_t *ctx)
+{
+    uint64_t now = current_time();
+
+    assert(ctx);
+
+    while (ctx->xmit_n > 0)
+    {
+        xmit_t *x = &XMIT_AT(ctx, 0);
+
+        if (SEQ_LEQ(x->end, ctx->snd_una))
+        {
+            if (!(x->flags & (XMIT_DELIVERED | XMIT_STALE)))
+                rack_delivered(ctx, x, now);
+        }
+        else if (!(x->flags & (XMIT_DELIVERED | XMIT_STALE)))
+        {
+            break;
+        }
+
+        if (x->flags & XMIT_RETRANSMIT)
+            --ctx->xmit_resent;
+        ctx->xmit_head = (ctx->xmit_head + 1) & (XMIT_LOG_SIZE - 1);
+        --ctx->xmit_n;
+    }
+
+    /* with nothing SACKed or resent, the log is in sequence order, so
+     * whatever's left was sent after everything delivered
+     */
+    if (ctx->scoreboard.n > 0 || ctx->xmit_resent > 0)
+        rack_detect_loss(sd, ctx);
+}
+
+/* a logged transmission has been delivered.  the latest sent of those
+ * becomes the reference for what's overdue, and gives the RTT to allow;
+ * but not a retransmission ACKed in less than the minimum RTT, since the
+ * ACK must have been for the original (RFC 8985, section 6.2).
+ */
+static void rack_delivered(context_t *ctx, xmit_t *x, uint64_t now)
+{
+    assert(ctx && x);
+
+    x->flags |= XMIT_DELIVERED;
+    if ((x->flags & XMIT_RETRANSMIT) && now - x->sent < ctx->min_rtt)
+        return;
+
+    if (x->sent > ctx->rack_sent ||
+        (x->sent == ctx->rack_sent && SEQ_GT(x->end, ctx->rack_end)))
+    {
+        ctx->rack_sent = x->sent;
+        ctx->rack_end  = x->end;
+        ctx->rack_rtt  = (uint32_t) MAX(now - x->sent, 1);
+    }
+}
+
+/* note whatever's been SACKed as delivered, then resend anything sent
+ * before the latest delivered segment that has been outstanding longer
+ * than that segment's RTT plus a reordering window.  if something isn't
+ * overdue yet, the RACK timer goes off when it will be.
+ */
+static void rack_detect_loss(mysocket_t sd, context_t *ctx)
+{
+    uint64_t now = current_time(), next = 0, due;
+    uint32_t reo_wnd;
+    unsigned int k, n = ctx->xmit_n;
+
+    assert(ctx);
+
+    for (k = 0; k < n; ++k)
+    {
+        xmit_t *x = &XMIT_AT(ctx, k);
+        uint32_t len = x->end - x->start;
+
+        if (!(x->flags & (XMIT_DELIVERED | XMIT_STALE)) &&
+            SEQ_GEQ(sack_skip(&ctx->scoreboard, x->start, &len), x->end))
+        {
+            rack_delivered(ctx, x, now);
+        }
+    }
+
+    /* a quarter of the minimum RTT allows for a little reordering
+     * (RFC 8985, section 6.2), without stretching recovery much; more,
+     * if reordering has been seen to need it
+     */
+    reo_wnd = (uint32_t) MIN((uint64_t) ctx->min_rtt / 4 * ctx->rack_reo_mult,
+                             ctx->srtt);
+
+    for (k = 0; k < n && ctx->rack_sent && !ctx->done; ++k)
+    {
+        xmit_t *x = &XMIT_AT(ctx, k);
+
+        if (x->flags & (XMIT_DELIVERED | XMIT_STALE))
+            continue;
+        if (x->sent > ctx->rack_sent)
+            break;      /* and so was everything after it */
+        if (x->sent == ctx->rack_sent && SEQ_GEQ(x->end, ctx->rack_end))
+            continue;
+
+        due = x->sent + ctx->rack_rtt + reo_wnd;
+        if (due > now)
+        {
+            next = next ? MIN(next, due) : due;
+            continue;
+        }
+
+        dprintf("RACK: %u-%u lost\n", x->start, x->end);
+        x->flags |= XMIT_STALE;
+        if (!ctx->cc.in_recovery)
+            enter_recovery(ctx);
+        retransmit_range(sd, ctx, x->start, x->end);
+    }
+
+    if (next)
+        stcp_timer_arm(&ctx->timers, &ctx->rack_timer, next);
+    else
+        stcp_timer_cancel(&ctx->timers, &ctx->rack_timer);
+}
+
+/* (re)start the tail loss probe timer while data is outstanding: two
+ * RTTs, plus the peer's delayed ACK time if only one segment is out to
+ * be ACKed (RFC 8985, section 7.2).  it's left off if the retransmission
+ * timer would go first anyway, during recovery (when ACKs are still
+ * coming), and while a probe is out already.  it needs SACK, for the
+ * probe's ACK to tell the sender what else is missing.
+ */
+static void arm_tlp(context_t *ctx)
+{
+    uint64_t pto, now = current_time();
+
+    assert(ctx);
+
+    if (!ctx->sack_enabled || !ctx->srtt || ctx->cc.in_recovery ||
+        ctx->tlp_active || ctx->snd_una == ctx->snd_max ||
+        !stcp_timer_pending(&ctx->rto_timer))
+    {
+        stcp_timer_cancel(&ctx->timers, &ctx->tlp_timer);
+        return;
+    }
+
+    pto = 2 * (uint64_t) ctx->srtt;
+    if (ctx->snd_max - ctx->snd_una <= ctx->mss)
+        pto += DELACK_TIMEOUT;
+    pto = MAX(pto, TLP_MIN_TIMEOUT);
+
+    if (now + pto >= ctx->rto_timer.expires)
+        stcp_timer_cancel(&ctx->timers, &ctx->tlp_timer);
+    else
+        stcp_timer_arm(&ctx->timers, &ctx->tlp_timer, now + pto);
+}
+
+/* no ACK has come back for a while, so the last segments sent, or their
+ * ACKs, may all have been lost; with nothing arriving at the peer after
+ * them, neither RACK nor duplicate ACKs would notice.  send one segment
+ * to draw an ACK: new data if the window allows, else the last segment
+ * again (RFC 8985, section 7.3).
+ */
+static void tlp_probe(mysocket_t sd, context_t *ctx)
+{
+    tcp_seq data_end = ctx->send_ring.start + ctx->send_ring.len;
+    tcp_seq wnd_end = ctx->snd_una + ctx->snd_wnd;
+
+    assert(ctx);
+
+    if (ctx->snd_una == ctx->snd_max)
+        return;
+
+    if (ctx->snd_nxt == ctx->snd_max && SEQ_LT(ctx->snd_max, data_end) &&
+        SEQ_LT(ctx->snd_max, wnd_end))
+    {
+        uint32_t len = MIN(MIN(data_end - ctx->snd_max, ctx->mss),
+                           wnd_end - ctx->snd_max);
+        uint8_t flags = TH_ACK;
+
+        if (ctx->fin_pending && ctx->snd_max + len == data_end)
+            flags |= TH_FIN;
+
+        dprintf("tail loss probe: new data at %u\n", ctx->snd_max);
+        send_segment(sd, ctx, ctx->snd_max, flags, len);
+        ctx->snd_max += len + ((flags & TH_FIN) ? 1 : 0);
+        ctx->snd_nxt = ctx->snd_max;
+        ctx->tlp_resent = FALSE;
+    }
+    else
+    {
+        tcp_seq start = SEQ_LT(data_end, ctx->snd_max) ? data_end
+                                                       : ctx->snd_max;
+
+        start = (start - ctx->snd_una > ctx->mss) ? start - ctx->mss
+                                                  : ctx->snd_una;
+        dprintf("tail loss probe: resending from %u\n", start);
+        undo_begin(ctx, FALSE);
+        retransmit_range(sd, ctx, start, ctx->snd_max);
+        ctx->tlp_resent = TRUE;
+    }
+
+    ctx->tlp_active = TRUE;
+    ctx->tlp_end = ctx->snd_max;
+    arm_rto(ctx);
+}
+
+
+/* forward error correction helpers */
+
+/* a new segment of len bytes at seq has been sent (with the FIN, if fin
+ * is TRUE).  it's added to the current group, unless it doesn't fit the
+ * group's pattern of equal-sized pieces; then that group is finished off
+ * and a new one started.  the group is finished as soon as it's full,
+ * or has a short (last) piece, or the FIN.
+ */
+static void fec_add(mysocket_t sd, context_t *ctx, tcp_seq seq,
+                    const char *data, uint32_t len, bool_t fin)
+{
+    uint32_t k;
+
+    assert(ctx && ctx->fec_group && data && len > 0);
+
+    if (ctx->fec_count > 0 && (seq != ctx->fec_end || len > ctx->fec_len))
+        fec_flush(sd, ctx);
+    if (ctx->done)
+        return;
+
+    if (ctx->fec_count == 0)
+    {
+        ctx->fec_start = ctx->fec_end = seq;
+        ctx->fec_len = len;
+        memcpy(ctx->fec_parity, data, len);
+    }
+    else
+    {
+        for (k = 0; k < len; ++k)
+            ctx->fec_parity[k] ^= data[k];
+    }
+
+    ctx->fec_end += len;
+    ctx->fec_fin = fin;
+    if (++ctx->fec_count == ctx->fec_group || len < ctx->fec_len || fin)
+        fec_flush(sd, ctx);
+}
+
+/* finish the current group, sending its parity segment.  a group of one
+ * gets none, since its parity would only be the segment again; a lost
+ * tail like that is left to a tail loss probe.  the header is built
+ * apart from send_buf, which may still hold the segment being added.
+ */
+static void fec_flush(mysocket_t sd, context_t *ctx)
+{
+    uint32_t segment[(sizeof(STCPHeader) + MAX_TCP_OPTIONS_LEN) /
+                     sizeof(uint32_t)];
+    STCPHeader *hdr = (STCPHeader *) segment;
+    stcp_opts_t opts;
+    size_t hdr_len;
+
+    assert(ctx && ctx->fec_count > 0);
+
+    if (ctx->fec_count == 1)
+    {
+        ctx->fec_count = 0;
+        return;
+    }
+
+    /* th_seq and the FEC option give the sequence space covered, and
+     * a FIN the group ended with.  with no ACK, th_ack and th_win are
+     * ignored.
+     */
+    memset(&opts, 0, sizeof(opts));
+    if (ctx->ts_enabled)
+    {
+        opts.ts_present = TRUE;
+        opts.ts_val = (uint32_t) current_time();
+        opts.ts_ecr = ctx->ts_recent;
+    }
+    opts.fec_present = TRUE;
+    opts.fec_end = ctx->fec_end;
+
+    memset(hdr, 0, sizeof(*hdr));
+    hdr_len = sizeof(*hdr) +
+        stcp_opt_build((char *) segment + sizeof(*hdr), MAX_TCP_OPTIONS_LEN,
+                       &opts);
+    assert(hdr_len - sizeof(*hdr) + ctx->fec_len <= ctx->snd_mss);
+
+    hdr->th_seq   = htonl(ctx->fec_start);
+    hdr->th_off   = hdr_len / sizeof(uint32_t);
+    hdr->th_flags = ctx->fec_fin ? TH_FIN : 0;
+
+    ctx->fec_count = 0;
+    if (stcp_network_send(sd, segment, hdr_len,
+                          ctx->fec_parity, (size_t) ctx->fec_len, NULL) < 0)
+    {
+        abort_connection(ctx, ECONNRESET);
+    }
+}
+
+/* a parity segment arrived, for the group of len-byte pieces from start
+ * to opts->fec_end (the last possibly shorter).  if exactly one piece of
+ * it is missing, rebuild it, XORing the parity with all the others, and
+ * take it as if it had arrived; likewise the FIN, if the group ended
+ * with it.  returns TRUE if anything new was taken.
+ */
+static bool_t fec_recover(mysocket_t sd, context_t *ctx, tcp_seq start,
+                          const char *parity, uint32_t len, bool_t has_fin,
+                          const stcp_opts_t *opts)
+{
+    seq_ring_t *h = &ctx->fec_history;
+    tcp_seq end = opts->fec_end, seq, hole = 0, hole_end = 0, piece;
+    unsigned int k, holes = 0;
+
+    assert(ctx && parity && opts && opts->fec_present);
+
+    if ((ctx->connection_state != CSTATE_ESTABLISHED &&
+         ctx->connection_state != CSTATE_FIN_WAIT_1 &&
+         ctx->connection_state != CSTATE_FIN_WAIT_2) ||
+        len == 0 || SEQ_GEQ(start, end) ||
+        end - start > MYSO_FEC_MAX * len)
+    {
+        return FALSE;
+    }
+
+    /* the data passed up is only kept once the peer turns out to be
+     * sending parity.  a group with a piece still missing starts no
+     * more than MYSO_FEC_MAX pieces before rcv_nxt.
+     */
+    if (!h->buf)
+    {
+        uint32_t size;
+
+        for (size = 1; size < MYSO_FEC_MAX * ctx->rcv_mss; size <<= 1)
+            ;
+        ring_init(h, size, ctx->rcv_nxt);
+        ctx->fec_buf = (char *) malloc(ctx->mtu);
+        assert(ctx->fec_buf);
+    }
+
+    if (SEQ_LT(start, h->start) || SEQ_GT(end, ctx->rcv_adv))
+        return FALSE;
+
+    /* find what's missing: there's room for only one gap */
+    seq = SEQ_LT(start, ctx->rcv_nxt) ? ctx->rcv_nxt : start;
+    for (k = 0; k <= ctx->reass.n && SEQ_LT(seq, end); ++k)
+    {
+        tcp_seq next = (k < ctx->reass.n) ? ctx->reass.blocks[k].start : end;
+
+        if (SEQ_GT(next, end))
+            next = end;
+        if (SEQ_GT(next, seq))
+        {
+            if (holes++)
+                return FALSE;
+            hole = seq;
+            hole_end = next;
+        }
+        if (k < ctx->reass.n && SEQ_GT(ctx->reass.blocks[k].end, seq))
+            seq = ctx->reass.blocks[k].end;
+    }
+
+    if (!holes)
+    {
+        /* all the data's here; only the FIN can be missing */
+        if (!has_fin || ctx->fin_seen)
+            return FALSE;
+        dprintf("FEC: rebuilt FIN at %u\n", end);
+        (void) receive_data(sd, ctx, end, NULL, 0, TRUE, opts);
+        return TRUE;
+    }
+
+    /* ...and it all has to be in one piece */
+    piece = start + (hole - start) / len * len;
+    if (SEQ_GT(hole_end, piece + len))
+        return FALSE;
+
+    memcpy(ctx->fec_buf, parity, len);
+    for (seq = start; SEQ_LT(seq, end); seq += len)
+    {
+        if (seq != piece)
+            fec_xor(ctx, seq, ctx->fec_buf, MIN(len, end - seq));
+    }
+
+    len = MIN(len, end - piece);
+    dprintf("FEC: rebuilt %u bytes at %u\n", len, piece);
+    (void) receive_data(sd, ctx, piece, ctx->fec_buf, len,
+                        has_fin && piece + len == end, opts);
+    return TRUE;
+}
+
+/* XOR the len bytes received from seq into buf.  they're in the history
+ * if they've been passed up, or else held out of order.
+ */
+static void fec_xor(const context_t *ctx, tcp_seq seq,
+                    char *buf, uint32_t len)
+{
+    uint32_t k;
+
+    assert(ctx && buf);
+
+    for (k = 0; k < len; ++k, ++seq)
+    {
+        const seq_ring_t *r = SEQ_LT(seq, ctx->rcv_nxt) ? &ctx->fec_history
+                                                        : &ctx->recv_ring;
+
+        buf[k] ^= r->buf[seq & (r->size - 1)];
+    }
+}
+
+
+/* reassembly helpers */
+
+/* hold out-of-order data, starting beyond rcv_nxt and within the receive
+ * window, until the data before it arrives.  the ring is sized for the
+ * receive buffer, and grows if the window it has to cover does, so this
+ * never needs more memory than the window.  if the data is too
+ * fragmented to track, the segment is dropped and the peer resends it.
+ */
+static void reass_insert(context_t *ctx, tcp_seq seq,
+                         const char *data, uint32_t len)
+{
+    seq_ring_t *r = &ctx->recv_ring;
+    uint32_t need = seq + len - ctx->rcv_nxt, size;
+    unsigned int k;
+
+    assert(ctx && data && len > 0);
+    assert(SEQ_GT(seq, ctx->rcv_nxt));
+    assert(need <= RECEIVE_RING_SIZE);
+
+    /* a copy of what's held already is reported as a duplicate, with
+     * the block holding it next (RFC 2883)
+     */
+    for (k = 0; k < ctx->reass.n; ++k)
+    {
+        if (SEQ_LEQ(ctx->reass.blocks[k].start, seq) &&
+            SEQ_LEQ(seq + len, ctx->reass.blocks[k].end))
+        {
+            ctx->dsack_pending = TRUE;
+            ctx->dsack.start = seq;
+            ctx->dsack.end = seq + len;
+            ctx->reass_last = seq;
+            return;
+        }
+    }
+
+    if (!r->buf || need > r->size)
+    {
+        need = MAX(need, ctx->rcv_buf);
+        for (size = r->buf ? r->size : 1; size < need; size <<= 1)
+            ;
+        if (!r->buf)
+            ring_init(r, size, ctx->rcv_nxt);
+        else
+            ring_grow(r, size);
+    }
+    assert(r->start == ctx->rcv_nxt);
+
+    if (!blocks_add(&ctx->reass, seq, seq + len))
+        return;
+
+    ring_store(r, seq, data, len);
+    if (SEQ_GT(seq + len, r->start + r->len))
+        r->len = seq + len - r->start;
+    ctx->reass_last = seq;
+}
+
+/* rcv_nxt has advanced; pass up any held data it has reached */
+static void reass_deliver(mysocket_t sd, context_t *ctx)
+{
+    seq_ring_t *r = &ctx->recv_ring;
+    uint32_t len;
+
+    assert(ctx);
+
+    if (!r->buf)
+        return;
+
+    /* forget whatever in-order data has overtaken */
+    blocks_trim(&ctx->reass, ctx->rcv_nxt);
+    len = ctx->rcv_nxt - r->start;
+    if (len < r->len)
+    {
+        ring_consume(r, len);
+    }
+    else
+    {
+        r->start = ctx->rcv_nxt;
+        r->len = 0;
+    }
+
+    if (ctx->reass.n > 0 && ctx->reass.blocks[0].start == ctx->rcv_nxt)
+    {
+        uint32_t offset = r->start & (r->size - 1), first;
+
+        len = ctx->reass.blocks[0].end - ctx->rcv_nxt;
+        first = MIN(len, r->size - offset);
+        deliver(sd, ctx, r->buf + offset, first);
+        if (len > first)
+            deliver(sd, ctx, r->buf, len - first);
+        ring_consume(r, len);
+        blocks_trim(&ctx->reass, ctx->rcv_nxt);
+    }
+}
+
+/* describe the held data as SACK blocks, after any D-SACK block.  the
+ * block holding the latest arrival goes first, so the sender learns about
+ * it even if this ACK's option space runs out (RFC 2018, section 4).
+ */
+static unsigned int reass_sack_blocks(const context_t *ctx,
+                                      stcp_sack_block_t *blocks,
+                                      unsigned int max_blocks)
+{
+    const seq_blocks_t *b = &ctx->reass;
+    unsigned int k, n = 0, first;
+
+    assert(ctx && blocks && max_blocks > 0);
+
+    if (ctx->dsack_pending)
+        blocks[n++] = ctx->dsack;
+    first = n;
+
+    for (k = 0; k < b->n && n < max_blocks; ++k)
+    {
+        if (SEQ_LEQ(b->blocks[k].start, ctx->reass_last) &&
+            SEQ_LT(ctx->reass_last, b->blocks[k].end))
+        {
+            blocks[n++] = b->blocks[k];
+            break;
+        }
+    }
+
+    for (k = 0; k < b->n && n < max_blocks; ++k)
+    {
+        if (n == first || b->blocks[k].start != blocks[first].start)
+            blocks[n++] = b->blocks[k];
+    }
+
+    return n;
+}
+
+
+/* sequence block set helpers */
+
+/* add [start, end) to the set, merging it with any blocks it overlaps or
+ * touches.  returns FALSE, leaving the set unchanged, if it would need
+ * more than SEQ_BLOCKS_MAX blocks.
+ */
+static bool_t blocks_add(seq_blocks_t *b, tcp_seq start, tcp_seq end)
+{
+    unsigned int j, k;
+
+    assert(b && SEQ_LT(start, end));
+
+    /* blocks j..k-1 are the ones the new block overlaps or touches */
+    for (j = 0; j < b->n && SEQ_LT(b->blocks[j].end, start); ++j)
+        ;
+    for (k = j; k < b->n && SEQ_LEQ(b->blocks[k].start, end); ++k)
+        ;
+
+    if (j == k && b->n == SEQ_BLOCKS_MAX)
+        return FALSE;
+
+    if (j < k)
+    {
+        if (SEQ_LT(b->blocks[j].start, start))
+            start = b->blocks[j].start;
+        if (SEQ_GT(b->blocks[k - 1].end, end))
+            end = b->blocks[k - 1].end;
+    }
+
+    /* replace blocks j..k-1 with the merged one */
+    memmove(&b->blocks[j + 1], &b->blocks[k],
+            (b->n - k) * sizeof(b->blocks[0]));
+    b->n = b->n - (k - j) + 1;
+    b->blocks[j].start = start;
+    b->blocks[j].end = end;
+    return TRUE;
+}
+
+/* drop everything before seq from the set */
+static void blocks_trim(seq_blocks_t *b, tcp_seq seq)
+{
+    unsigned int k;
+
+    assert(b);
+
+    for (k = 0; k < b->n && SEQ_LEQ(b->blocks[k].end, seq); ++k)
+        ;
+
+    if (k > 0)
+    {
+        memmove(&b->blocks[0], &b->blocks[k],
+                (b->n - k) * sizeof(b->blocks[0]));
+        b->n -= k;
+    }
+
+    if (b->n > 0 && SEQ_LT(b->blocks[0].start, seq))
+        b->blocks[0].start = seq;
+}
+
+
+/* ring buffer helpers */
+
+static void ring_init(seq_ring_t *r, uint32_t size, tcp_seq start)
+{
+    assert(r);
+    assert(size > 0 && (size & (size - 1)) == 0);
+
+    r->buf = (char *) malloc(size);
+    assert(r->buf);
+
+    r->size  = size;
+    r->start = start;
+    r->len   = 0;
+}
+
+/* move the ring's contents to a bigger buffer */
+static void ring_grow(seq_ring_t *r, uint32_t size)
+{
+    seq_ring_t grown;
+    uint32_t offset, first;
+
+    assert(r && r->buf && size > r->size);
+
+    ring_init(&grown, size, r->start);
+
+    offset = r->start & (r->size - 1);
+    first = MIN(r->len, r->size - offset);
+    ring_store(&grown, r->start, r->buf + offset, first);
+    ring_store(&grown, r->start + first, r->buf, r->len - first);
+    grown.len = r->len;
+
+    free(r->buf);
+    *r = grown;
+}
+
+/* append data from the application to the end of the ring.  returns the
+ * number of bytes added.
+ */
+static uint32_t ring_read_app(mysocket_t sd, seq_ring_t *r)
+{
+    uint32_t tail, contig;
+
+    assert(r && r->len < r->size);
+
+    tail = (r->start + r->len) & (r->size - 1);
+    contig = MIN(r->size - r->len, r->size - tail);
+
+    contig = stcp_app_recv(sd, r->buf + tail, contig);
+    r->len += contig;
+    return contig;
+}
+
+/* copy len bytes starting at sequence number seq out of the ring */
+static void ring_copy_out(const seq_ring_t *r, tcp_seq seq,
+                          void *dst, uint32_t len)
+{
+    uint32_t offset, first;
+
+    assert(r && dst);
+    assert(SEQ_GEQ(seq, r->start));
+    assert(seq - r->start + len <= r->len);
+
+    offset = seq & (r->size - 1);
+    first = MIN(len, r->size - offset);
+
+    memcpy(dst, r->buf + offset, first);
+    memcpy((char *) dst + first, r->buf, len - first);
+}
+
+/* drop acknowledged data from the front of the ring */
+static void ring_consume(seq_ring_t *r, uint32_t len)
+{
+    assert(r && len <= r->len);
+
+    r->start += len;
+    r->len -= len;
+}
+
+/* copy len bytes into the ring at sequence number seq, which must lie
+ * within size bytes of the start.  this doesn't change len; the caller
+ * keeps track of which bytes are valid.
+ */
+static void ring_store(seq_ring_t *r, tcp_seq seq,
+                       const void *src, uint32_t len)
+{
+    uint32_t offset, first;
+
+    assert(r && src);
+    assert(SEQ_GEQ(seq, r->start));
+    assert(seq - r->start + len <= r->size);
+
+    offset = seq & (r->size - 1);
+    first = MIN(len, r->size - offset);
+
+    memcpy(r->buf + offset, src, first);
+    memcpy(r->buf, (const char *) src + first, len - first);
+}
+
+/* add len bytes to the end of the ring, dropping as many from the front
+ * as it takes to make room
+ */
+static void ring_append(seq_ring_t *r, const void *src, uint32_t len)
+{
+    assert(r && src);
+
+    if (len > r->size)
+    {
+        uint32_t skip = len - r->size;
+
+        ring_consume(r, r->len);
+        r->start += skip;
+        src = (const char *) src + skip;
+        len = r->size;
+    }
+
+    if (r->len + len > r->size)
+        ring_consume(r, r->len + len - r->size);
+    ring_store(r, r->start + r->len, src, len);
+    r->len += len;
+}
+
+
+/* returns the current time in microseconds.  this is on the monotonic
+ * clock, so it converts directly to the abstime expected by
+ * stcp_wait_for_event(), and never jumps when the system time is set.
+ */
+static uint64_t current_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
 
 
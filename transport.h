@@ -46,11 +46,11 @@ typedef struct tcphdr
     tcp_seq  th_seq;    /* sequence number */
     tcp_seq  th_ack;    /* acknowledgement number */
 #if __BYTE_ORDER == __LITTLE_ENDIAN
-    uint8_t  th_x2:4;   /* unused */
+    uint8_t  th_x2:4;   /* ECN field (see below) */
     uint8_t  th_off:4;  /* data offset */
 #elif __BYTE_ORDER == __BIG_ENDIAN
     uint8_t  th_off:4;  /* data offset */
-    uint8_t  th_x2:4;   /* unused */
+    uint8_t  th_x2:4;   /* ECN field (see below) */
 #else
 #error __BYTE_ORDER must be defined as __LITTLE_ENDIAN or __BIG_ENDIAN!
 #endif
@@ -61,11 +61,20 @@ typedef struct tcphdr
 #define TH_PUSH 0x08    /* ...or this */
 #define TH_ACK  0x10
 #define TH_URG  0x20    /* ...or this */
+#define TH_ECE  0x40    /* ECN echo (RFC 3168) */
+#define TH_CWR  0x80    /* congestion window reduced */
     uint16_t th_win;    /* window */
     uint16_t th_sum;    /* checksum */
     uint16_t th_urp;    /* urgent pointer (unused in STCP) */
 } __attribute__ ((packed)) STCPHeader;
 
+/* with no IP header of its own, an STCP packet carries the IP ECN field
+ * in th_x2: the sender sets TH_X2_ECT on packets whose transport will
+ * react to a mark, and the network adds TH_X2_CE to mark them.
+ */
+#define TH_X2_ECT   0x1     /* ECN-capable transport */
+#define TH_X2_CE    0x2     /* congestion experienced */
+
 
 /* starting byte position of data in TCP packet p */
 #define TCP_DATA_START(p) (((STCPHeader *) p)->th_off * sizeof(uint32_t))
@@ -73,9 +82,15 @@ typedef struct tcphdr
 /* length of options (in bytes) in TCP packet p */
 #define TCP_OPTIONS_LEN(p) (TCP_DATA_START(p) - sizeof(struct tcphdr))
 
-/* STCP maximum segment size */
+/* STCP maximum segment size, if the peer doesn't say otherwise (RFC 879) */
 #define STCP_MSS 536
 
+/* sequence number comparisons, modulo 2^32 */
+#define SEQ_LT(a,b)   ((int32_t) ((a) - (b)) < 0)
+#define SEQ_LEQ(a,b)  ((int32_t) ((a) - (b)) <= 0)
+#define SEQ_GT(a,b)   ((int32_t) ((a) - (b)) > 0)
+#define SEQ_GEQ(a,b)  ((int32_t) ((a) - (b)) >= 0)
+
 
 #ifndef MIN
     #define MIN(x,y)  ((x) <= (y) ? (x) : (y))
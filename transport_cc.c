@@ -0,0 +1,168 @@
+/* transport_cc.c--congestion control algorithm selection, and window
+ * arithmetic shared by the loss-based algorithms.
+ */
+
+#include <string.h>
+#include <assert.h>
+#include "mysock.h"
+#include "transport.h"
+#include "transport_cc.h"
+
+
+/* cwnd never grows beyond this, whatever the algorithm asks for */
+#define MAX_CWND    (1U << 30)
+
+/* algorithms indexed by MYCC_* */
+static const stcp_cc_ops_t *cc_algorithms[MYCC_NUM_ALGORITHMS] =
+{
+    &stcp_cc_reno,      /* MYCC_RENO */
+    &stcp_cc_newreno,   /* MYCC_NEWRENO */
+    &stcp_cc_cubic,     /* MYCC_CUBIC */
+    &stcp_cc_bbr        /* MYCC_BBR */
+};
+
+
+/* set up congestion control for a new connection, using the given
+ * algorithm (MYCC_*) and maximum segment size.
+ */
+void stcp_cc_init(stcp_cc_t *cc, int algorithm, uint32_t mss)
+{
+    assert(cc && mss > 0);
+    assert(algorithm >= 0 && algorithm < MYCC_NUM_ALGORITHMS);
+
+    memset(cc, 0, sizeof(*cc));
+    cc->ops      = cc_algorithms[algorithm];
+    cc->mss      = mss;
+    cc->cwnd     = STCP_CC_INITIAL_WINDOW(mss);
+    cc->ssthresh = MAX_CWND;    /* slow start until the first loss */
+
+    assert(cc->ops);
+    if (cc->ops->init)
+        cc->ops->init(cc);
+}
+
+/* start from what an earlier connection to the same host ended with (see
+ * transport_metrics.h), rather than from a cold start: the window it had,
+ * but not beyond the ssthresh it found, nor below the initial window.
+ */
+void stcp_cc_warm(stcp_cc_t *cc, uint32_t cwnd, uint32_t ssthresh)
+{
+    assert(cc && cc->ops);
+
+    cc->ssthresh = MIN(MAX(ssthresh, 2 * cc->mss), MAX_CWND);
+    cc->cwnd = MAX(cc->cwnd, MIN(cwnd, cc->ssthresh));
+}
+
+/* returns TRUE if the sender was using the window it was given.  there's
+ * no point growing cwnd while the application (or the peer's window) is
+ * what limits the amount of data in flight (RFC 7661).
+ */
+bool_t stcp_cc_cwnd_limited(const stcp_cc_t *cc, const stcp_cc_ack_t *ack)
+{
+    assert(cc && ack);
+
+    if (cc->cwnd < cc->ssthresh)
+        return 2 * ack->in_flight >= cc->cwnd;
+    return ack->in_flight + cc->mss > cc->cwnd;
+}
+
+/* standard window growth (RFC 5681): slow start below ssthresh, with
+ * appropriate byte counting (RFC 3465, L = 2), then one segment per
+ * window's worth of acknowledged data.
+ */
+void stcp_cc_grow(stcp_cc_t *cc, const stcp_cc_ack_t *ack)
+{
+    assert(cc && ack);
+
+    if (!stcp_cc_cwnd_limited(cc, ack))
+        return;
+
+    if (cc->cwnd < cc->ssthresh)
+    {
+        cc->cwnd += MIN(ack->bytes_acked, 2 * cc->mss);
+    }
+    else
+    {
+        cc->bytes_acked += ack->bytes_acked;
+        if (cc->bytes_acked >= cc->cwnd)
+        {
+            cc->bytes_acked -= cc->cwnd;
+            cc->cwnd += cc->mss;
+        }
+    }
+
+    cc->cwnd = MIN(cc->cwnd, MAX_CWND);
+}
+
+/* window handling during fast recovery (RFC 5681/6582).  each duplicate
+ * ACK means another segment has left the network, so the window is
+ * inflated to let a new one in.  if partial_acks is FALSE (Reno), the first
+ * new ACK ends recovery; otherwise (NewReno), recovery lasts until
+ * everything outstanding at the time of the loss has been acknowledged.
+ *
+ * returns TRUE if the ACK was consumed by recovery, FALSE if the
+ * connection isn't in recovery.
+ */
+bool_t stcp_cc_recovery_ack(stcp_cc_t *cc, const stcp_cc_ack_t *ack,
+                            bool_t partial_acks)
+{
+    uint32_t in_flight;
+
+    assert(cc && ack);
+
+    if (!cc->in_recovery)
+        return FALSE;
+
+    if (ack->bytes_acked == 0)
+    {
+        cc->cwnd = MIN(cc->cwnd + cc->mss, MAX_CWND);
+        return TRUE;
+    }
+
+    in_flight = ack->in_flight - MIN(ack->in_flight, ack->bytes_acked);
+
+    if (!partial_acks || SEQ_GEQ(ack->ack, cc->recover))
+    {
+        /* deflate the window; don't allow a burst on leaving recovery */
+        cc->cwnd = MIN(cc->ssthresh, MAX(in_flight, cc->mss) + cc->mss);
+        cc->bytes_acked = 0;
+        cc->in_recovery = FALSE;
+        return TRUE;
+    }
+
+    /* partial ACK: deflate by the amount acknowledged, adding back one
+     * segment for the retransmission that it triggers.
+     */
+    cc->cwnd -= MIN(cc->cwnd, ack->bytes_acked);
+    if (ack->bytes_acked >= cc->mss)
+        cc->cwnd += cc->mss;
+    cc->cwnd = MAX(cc->cwnd, cc->mss);
+    return TRUE;
+}
+
+/* a loss response turned out to be needless (the data was only reordered
+ * or delayed): go back to the window from before it, leaving any fast
+ * recovery it began.  this is the same for every algorithm; whatever else
+ * the response changed is left to settle.
+ */
+void stcp_cc_undo(stcp_cc_t *cc, uint32_t cwnd, uint32_t ssthresh)
+{
+    assert(cc);
+
+    cc->cwnd = MAX(cc->cwnd, MIN(cwnd, MAX_CWND));
+    cc->ssthresh = MAX(cc->ssthresh, ssthresh);
+    cc->bytes_acked = 0;
+    cc->in_recovery = FALSE;
+}
+
+uint32_t stcp_cc_get_cwnd(const stcp_cc_t *cc)
+{
+    assert(cc);
+    return cc->cwnd;
+}
+
+uint32_t stcp_cc_get_ssthresh(const stcp_cc_t *cc)
+{
+    assert(cc);
+    return cc->ssthresh;
+}
@@ -0,0 +1,165 @@
+/* transport_cc.h--pluggable congestion control for the transport layer.
+ *
+ * each algorithm provides a table of callbacks (stcp_cc_ops_t).  the
+ * transport reports ACKs, losses and retransmission timeouts through
+ * these (and congestion marks, if ECN is in use), never has more than
+ * cwnd() bytes outstanding, and spaces its segments out at pacing_rate()
+ * if the algorithm asks for pacing (or else, with MYSO_PACING, at cwnd()
+ * over the RTT).  the algorithm is chosen per mysocket with the
+ * MYSO_CONGESTION option.
+ */
+
+#ifndef __TRANSPORT_CC_H__
+#define __TRANSPORT_CC_H__
+
+#include "transport.h"
+
+
+/* what the transport knows about an ACK, passed to on_ack() */
+typedef struct
+{
+    tcp_seq  ack;           /* cumulative acknowledgement */
+    uint32_t bytes_acked;   /* newly acknowledged bytes; 0 for a dup ACK */
+    uint32_t in_flight;     /* bytes outstanding before this ACK */
+    uint32_t rtt;           /* RTT sample taken from this ACK (us), or 0 */
+    uint32_t srtt;          /* smoothed RTT (us), or 0 if not yet known */
+    uint64_t now;           /* time of arrival (us) */
+} stcp_cc_ack_t;
+
+struct stcp_cc;
+
+typedef struct
+{
+    const char *name;
+
+    /* set up algorithm-specific state; cwnd and ssthresh are already at
+     * their initial values when this is called.
+     */
+    void (*init)(struct stcp_cc *cc);
+
+    /* an ACK arrived.  this is called for every ACK that advances
+     * snd_una, and for duplicate ACKs while in fast recovery.
+     */
+    void (*on_ack)(struct stcp_cc *cc, const stcp_cc_ack_t *ack);
+
+    /* loss was detected without a timeout (e.g. duplicate ACKs); enter
+     * fast recovery until everything up to recover is acknowledged.
+     * dupacks is the number of duplicate ACKs seen so far, each for a
+     * segment that has left the network.
+     */
+    void (*on_loss)(struct stcp_cc *cc, uint32_t in_flight,
+                    uint32_t dupacks, tcp_seq recover, uint64_t now);
+
+    /* the retransmission timer expired */
+    void (*on_timeout)(struct stcp_cc *cc, uint32_t in_flight, uint64_t now);
+
+    /* the peer echoed a congestion mark (RFC 3168).  reduce the window
+     * as for a loss, but without fast recovery, since nothing needs
+     * resending.  may be NULL if the algorithm takes no notice of marks.
+     */
+    void (*on_ecn)(struct stcp_cc *cc, uint32_t in_flight, uint64_t now);
+
+    /* the current congestion window and slow start threshold, in bytes */
+    uint32_t (*cwnd)(const struct stcp_cc *cc);
+    uint32_t (*ssthresh)(const struct stcp_cc *cc);
+
+    /* rate (bytes/s) at which to pace segments, or 0 to leave it to
+     * the transport.  may be NULL if the algorithm has no rate of its
+     * own.
+     */
+    uint64_t (*pacing_rate)(const struct stcp_cc *cc);
+} stcp_cc_ops_t;
+
+/* CUBIC working state (RFC 8312); windows are in bytes */
+typedef struct
+{
+    uint32_t w_max;         /* window just before the last reduction */
+    uint32_t w_last_max;    /* w_max before that, for fast convergence */
+    uint64_t epoch_start;   /* start of the current growth epoch, or 0 */
+    uint32_t origin;        /* window at which the cubic curve plateaus */
+    double   k;             /* time (s) to grow back to origin */
+    double   w_est;         /* Reno-equivalent window ("TCP-friendly") */
+} cc_cubic_t;
+
+/* BBR working state.  the model is the bottleneck bandwidth (the
+ * windowed maximum of per-round delivery rates) and the path's minimum
+ * RTT; rates are in bytes/s, times in microseconds.
+ */
+#define BBR_BW_FILTER_LEN 10    /* rounds over which btl_bw is the max */
+
+typedef struct
+{
+    int      mode;          /* startup, drain, probe_bw or probe_rtt */
+    double   pacing_gain;
+    double   cwnd_gain;
+
+    uint64_t bw_samples[BBR_BW_FILTER_LEN];
+    uint64_t btl_bw;        /* max of bw_samples, or 0 if unknown */
+    uint32_t min_rtt;       /* or 0 if unknown */
+    uint64_t min_rtt_stamp; /* when min_rtt was last lowered/refreshed */
+    uint32_t srtt;          /* most recent smoothed RTT from the transport */
+
+    uint64_t delivered;         /* bytes delivered over the connection */
+    unsigned int round_count;   /* rounds (roughly RTTs) sampled so far */
+    uint64_t round_start;       /* time the current round began */
+    uint64_t round_delivered;   /* delivered at round_start */
+    bool_t   round_cwnd_limited;    /* FALSE if app-limited all round */
+
+    uint64_t full_bw;           /* bw at the last 25% increase in startup */
+    unsigned int full_bw_count; /* rounds since that increase */
+    bool_t   filled_pipe;
+
+    unsigned int cycle_index;   /* position in the probe_bw gain cycle */
+    uint64_t cycle_start;
+    uint64_t probe_rtt_done;    /* time probe_rtt ends */
+    uint32_t prior_cwnd;        /* cwnd to restore after probe_rtt/loss */
+} cc_bbr_t;
+
+/* per-connection congestion control state */
+typedef struct stcp_cc
+{
+    const stcp_cc_ops_t *ops;
+
+    uint32_t mss;
+    uint32_t cwnd;          /* congestion window (bytes) */
+    uint32_t ssthresh;      /* slow start threshold (bytes) */
+    uint32_t bytes_acked;   /* acked bytes not yet credited in CA */
+
+    bool_t   in_recovery;   /* TRUE during fast recovery */
+    tcp_seq  recover;       /* recovery ends once this is acknowledged */
+
+    union
+    {
+        cc_cubic_t cubic;
+        cc_bbr_t   bbr;
+    } u;    /* algorithm-private state */
+} stcp_cc_t;
+
+
+/* initial window (RFC 3390) */
+#define STCP_CC_INITIAL_WINDOW(mss) MIN(4 * (mss), MAX(2 * (mss), 4380))
+
+
+/* transport_cc.c */
+void stcp_cc_init(stcp_cc_t *cc, int algorithm, uint32_t mss);
+void stcp_cc_warm(stcp_cc_t *cc, uint32_t cwnd, uint32_t ssthresh);
+
+#define stcp_cc_cwnd(cc)      ((cc)->ops->cwnd(cc))
+#define stcp_cc_ssthresh(cc)  ((cc)->ops->ssthresh(cc))
+
+/* helpers shared by the loss-based algorithms */
+void stcp_cc_grow(stcp_cc_t *cc, const stcp_cc_ack_t *ack);
+bool_t stcp_cc_cwnd_limited(const stcp_cc_t *cc, const stcp_cc_ack_t *ack);
+bool_t stcp_cc_recovery_ack(stcp_cc_t *cc, const stcp_cc_ack_t *ack,
+                            bool_t partial_acks);
+void stcp_cc_undo(stcp_cc_t *cc, uint32_t cwnd, uint32_t ssthresh);
+uint32_t stcp_cc_get_cwnd(const stcp_cc_t *cc);
+uint32_t stcp_cc_get_ssthresh(const stcp_cc_t *cc);
+
+/* available algorithms */
+extern const stcp_cc_ops_t stcp_cc_reno;
+extern const stcp_cc_ops_t stcp_cc_newreno;
+extern const stcp_cc_ops_t stcp_cc_cubic;
+extern const stcp_cc_ops_t stcp_cc_bbr;
+
+#endif  /* __TRANSPORT_CC_H__ */
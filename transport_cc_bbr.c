@@ -0,0 +1,347 @@
+/* transport_cc_bbr.c--model-based congestion control, after BBR.
+ *
+ * rather than treating loss as the congestion signal, BBR keeps a model of
+ * the path: the bottleneck bandwidth (the highest delivery rate seen over
+ * the last few round trips) and the round-trip propagation delay (the
+ * lowest RTT seen over the last ten seconds).  the sender paces segments
+ * at roughly the bottleneck bandwidth and keeps about one bandwidth-delay
+ * product in flight, which fills the pipe without building a queue.
+ *
+ * the transport doesn't keep per-segment delivery state, so delivery rate
+ * is sampled once per round (about one RTT) from the bytes acknowledged
+ * during it.
+ */
+
+#include <assert.h>
+#include "mysock.h"
+#include "transport.h"
+#include "transport_cc.h"
+
+
+enum { BBR_STARTUP, BBR_DRAIN, BBR_PROBE_BW, BBR_PROBE_RTT };
+
+#define BBR_HIGH_GAIN       2.885   /* 2/ln(2): doubles delivery per round */
+#define BBR_CWND_GAIN       2.0     /* cwnd in bdps, once the pipe is full */
+#define BBR_CYCLE_LEN       8       /* phases in the probe_bw gain cycle */
+#define BBR_FULL_BW_THRESH  1.25    /* startup growth that isn't a plateau */
+#define BBR_FULL_BW_ROUNDS  3       /* rounds of plateau before draining */
+#define BBR_MIN_RTT_WINDOW  10000000    /* min_rtt expires after this (us) */
+#define BBR_PROBE_RTT_TIME  200000      /* time spent in probe_rtt (us) */
+#define BBR_MIN_ROUND       1000        /* shortest round sampled (us) */
+#define BBR_MIN_CWND(mss)   (4 * (mss))
+#define BBR_MAX_CWND        (1U << 30)
+
+/* pacing gains in probe_bw: probe for more bandwidth for a round, drain
+ * whatever queue that built for a round, then cruise for six.
+ */
+static const double bbr_pacing_gain[BBR_CYCLE_LEN] =
+{
+    1.25, 0.75, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0
+};
+
+
+static void bbr_init(stcp_cc_t *cc);
+static void bbr_on_ack(stcp_cc_t *cc, const stcp_cc_ack_t *ack);
+static void bbr_on_loss(stcp_cc_t *cc, uint32_t in_flight,
+                        uint32_t dupacks, tcp_seq recover, uint64_t now);
+static void bbr_on_timeout(stcp_cc_t *cc, uint32_t in_flight, uint64_t now);
+static uint64_t bbr_pacing_rate(const stcp_cc_t *cc);
+static void bbr_update_min_rtt(stcp_cc_t *cc, const stcp_cc_ack_t *ack);
+static void bbr_update_round(stcp_cc_t *cc, const stcp_cc_ack_t *ack);
+static void bbr_update_mode(stcp_cc_t *cc, const stcp_cc_ack_t *ack);
+static void bbr_set_cwnd(stcp_cc_t *cc, uint32_t acked);
+static void bbr_enter_probe_bw(cc_bbr_t *b, uint64_t now);
+static uint32_t bbr_target_cwnd(const stcp_cc_t *cc, double gain);
+
+
+const stcp_cc_ops_t stcp_cc_bbr =
+{
+    "bbr",
+    bbr_init,
+    bbr_on_ack,
+    bbr_on_loss,
+    bbr_on_timeout,
+    NULL,   /* the model already keeps the queue short */
+    stcp_cc_get_cwnd,
+    stcp_cc_get_ssthresh,
+    bbr_pacing_rate
+};
+
+
+static void bbr_init(stcp_cc_t *cc)
+{
+    cc_bbr_t *b = &cc->u.bbr;
+
+    b->mode = BBR_STARTUP;
+    b->pacing_gain = BBR_HIGH_GAIN;
+    b->cwnd_gain = BBR_HIGH_GAIN;
+    b->prior_cwnd = cc->cwnd;
+}
+
+static void bbr_on_ack(stcp_cc_t *cc, const stcp_cc_ack_t *ack)
+{
+    cc_bbr_t *b;
+    uint32_t acked;
+
+    assert(cc && ack);
+    b = &cc->u.bbr;
+
+    /* a duplicate ACK means another segment has reached the receiver */
+    acked = ack->bytes_acked ? ack->bytes_acked : cc->mss;
+    b->delivered += acked;
+    if (ack->srtt)
+        b->srtt = ack->srtt;
+    if (ack->in_flight + cc->mss > cc->cwnd)
+        b->round_cwnd_limited = TRUE;
+
+    bbr_update_min_rtt(cc, ack);
+    bbr_update_round(cc, ack);
+    bbr_update_mode(cc, ack);
+
+    /* a loss doesn't shrink the model, but while recovering hold the
+     * window to what's been getting through, as Reno would.  pacing
+     * smooths out the burst when the prior window is restored.
+     */
+    if (stcp_cc_recovery_ack(cc, ack, TRUE))
+    {
+        if (!cc->in_recovery)
+            cc->cwnd = MAX(cc->cwnd, b->prior_cwnd);
+        return;
+    }
+
+    if (ack->bytes_acked)
+        bbr_set_cwnd(cc, acked);
+}
+
+/* a single loss isn't taken as a sign of congestion; the window is held
+ * (not cut) through recovery, and restored afterwards.
+ */
+static void bbr_on_loss(stcp_cc_t *cc, uint32_t in_flight,
+                        uint32_t dupacks, tcp_seq recover, uint64_t now)
+{
+    assert(cc);
+
+    cc->u.bbr.prior_cwnd = cc->cwnd;
+    cc->ssthresh = MAX(cc->cwnd, BBR_MIN_CWND(cc->mss));
+    cc->in_recovery = TRUE;
+    cc->recover = recover;
+}
+
+/* everything in flight is presumed lost, so start again from one segment;
+ * the model survives, so the window returns to the bdp within a few
+ * round trips.
+ */
+static void bbr_on_timeout(stcp_cc_t *cc, uint32_t in_flight, uint64_t now)
+{
+    assert(cc);
+
+    if (!cc->in_recovery)
+        cc->u.bbr.prior_cwnd = cc->cwnd;
+    cc->cwnd = cc->mss;
+    cc->in_recovery = FALSE;
+}
+
+static uint64_t bbr_pacing_rate(const stcp_cc_t *cc)
+{
+    const cc_bbr_t *b;
+
+    assert(cc);
+    b = &cc->u.bbr;
+
+    if (b->btl_bw)
+        return (uint64_t) (b->pacing_gain * b->btl_bw);
+
+    /* no bandwidth sample yet: pace the window out over an RTT */
+    if (b->srtt)
+        return (uint64_t) (b->pacing_gain * cc->cwnd * 1000000.0 / b->srtt);
+
+    return 0;
+}
+
+/* the propagation delay is the lowest RTT seen recently.  if it hasn't been
+ * seen again for BBR_MIN_RTT_WINDOW, it may have changed (or been hidden
+ * by our own queue), so accept the next sample and go and measure it in
+ * probe_rtt.
+ */
+static void bbr_update_min_rtt(stcp_cc_t *cc, const stcp_cc_ack_t *ack)
+{
+    cc_bbr_t *b = &cc->u.bbr;
+    bool_t expired;
+
+    expired = b->min_rtt_stamp &&
+              ack->now - b->min_rtt_stamp > BBR_MIN_RTT_WINDOW;
+
+    if (ack->rtt && (!b->min_rtt || ack->rtt <= b->min_rtt || expired))
+    {
+        b->min_rtt = ack->rtt;
+        b->min_rtt_stamp = ack->now;
+    }
+
+    if (expired && b->mode != BBR_PROBE_RTT)
+    {
+        b->mode = BBR_PROBE_RTT;
+        b->pacing_gain = 1.0;
+        b->cwnd_gain = 1.0;
+        b->probe_rtt_done = ack->now + BBR_PROBE_RTT_TIME;
+        if (!cc->in_recovery)
+            b->prior_cwnd = cc->cwnd;
+    }
+}
+
+/* close the round once an RTT has passed, and take its delivery rate as a
+ * bandwidth sample.  a round in which the sender wasn't using its window
+ * only measures the application, so it may raise the estimate but never
+ * lower it.
+ */
+static void bbr_update_round(stcp_cc_t *cc, const stcp_cc_ack_t *ack)
+{
+    cc_bbr_t *b = &cc->u.bbr;
+    uint64_t interval, bw;
+    uint32_t round_len;
+    int k;
+
+    if (!b->round_start)
+    {
+        b->round_start = ack->now;
+        b->round_delivered = b->delivered;
+        return;
+    }
+
+    round_len = MAX(b->min_rtt ? b->min_rtt : b->srtt, BBR_MIN_ROUND);
+    interval = ack->now - b->round_start;
+    if (interval < round_len)
+        return;
+
+    bw = (b->delivered - b->round_delivered) * 1000000 / interval;
+    if (b->round_cwnd_limited || bw > b->btl_bw)
+    {
+        b->bw_samples[b->round_count % BBR_BW_FILTER_LEN] = bw;
+        ++b->round_count;
+
+        b->btl_bw = 0;
+        for (k = 0; k < BBR_BW_FILTER_LEN; ++k)
+            b->btl_bw = MAX(b->btl_bw, b->bw_samples[k]);
+
+        /* the pipe is full once bandwidth stops growing in startup */
+        if (!b->filled_pipe && b->round_cwnd_limited)
+        {
+            if (b->btl_bw >= b->full_bw * BBR_FULL_BW_THRESH)
+            {
+                b->full_bw = b->btl_bw;
+                b->full_bw_count = 0;
+            }
+            else if (++b->full_bw_count >= BBR_FULL_BW_ROUNDS)
+            {
+                b->filled_pipe = TRUE;
+            }
+        }
+    }
+
+    b->round_start = ack->now;
+    b->round_delivered = b->delivered;
+    b->round_cwnd_limited = FALSE;
+}
+
+static void bbr_update_mode(stcp_cc_t *cc, const stcp_cc_ack_t *ack)
+{
+    cc_bbr_t *b = &cc->u.bbr;
+    uint32_t in_flight;
+
+    in_flight = ack->in_flight - MIN(ack->in_flight, ack->bytes_acked);
+
+    switch (b->mode)
+    {
+    case BBR_STARTUP:
+        if (b->filled_pipe)
+        {
+            /* empty the queue startup built at high gain */
+            b->mode = BBR_DRAIN;
+            b->pacing_gain = 1.0 / BBR_HIGH_GAIN;
+            b->cwnd_gain = BBR_HIGH_GAIN;
+        }
+        break;
+
+    case BBR_DRAIN:
+        if (in_flight <= bbr_target_cwnd(cc, 1.0))
+            bbr_enter_probe_bw(b, ack->now);
+        break;
+
+    case BBR_PROBE_BW:
+        if (ack->now - b->cycle_start > MAX(b->min_rtt, BBR_MIN_ROUND))
+        {
+            b->cycle_index = (b->cycle_index + 1) % BBR_CYCLE_LEN;
+            b->cycle_start = ack->now;
+            b->pacing_gain = bbr_pacing_gain[b->cycle_index];
+        }
+        break;
+
+    case BBR_PROBE_RTT:
+        if (ack->now >= b->probe_rtt_done)
+        {
+            b->min_rtt_stamp = ack->now;
+            cc->cwnd = MAX(cc->cwnd, b->prior_cwnd);
+            if (b->filled_pipe)
+            {
+                bbr_enter_probe_bw(b, ack->now);
+            }
+            else
+            {
+                b->mode = BBR_STARTUP;
+                b->pacing_gain = BBR_HIGH_GAIN;
+                b->cwnd_gain = BBR_HIGH_GAIN;
+            }
+        }
+        break;
+    }
+}
+
+/* grow towards cwnd_gain bdps.  until the pipe is full, the model is still
+ * catching up with the path, so keep growing as in slow start.
+ */
+static void bbr_set_cwnd(stcp_cc_t *cc, uint32_t acked)
+{
+    cc_bbr_t *b = &cc->u.bbr;
+    uint32_t target;
+
+    target = bbr_target_cwnd(cc, b->cwnd_gain);
+
+    if (b->filled_pipe)
+        cc->cwnd = MIN(cc->cwnd + acked, target);
+    else if (cc->cwnd < target ||
+             b->delivered < STCP_CC_INITIAL_WINDOW(cc->mss))
+        cc->cwnd += acked;
+
+    cc->cwnd = MIN(MAX(cc->cwnd, BBR_MIN_CWND(cc->mss)), BBR_MAX_CWND);
+
+    /* keep only a handful of segments in flight while measuring min_rtt */
+    if (b->mode == BBR_PROBE_RTT)
+        cc->cwnd = MIN(cc->cwnd, BBR_MIN_CWND(cc->mss));
+}
+
+static void bbr_enter_probe_bw(cc_bbr_t *b, uint64_t now)
+{
+    b->mode = BBR_PROBE_BW;
+    b->cwnd_gain = BBR_CWND_GAIN;
+    b->cycle_index = 2;     /* cruise first; the queue was just drained */
+    b->cycle_start = now;
+    b->pacing_gain = bbr_pacing_gain[b->cycle_index];
+}
+
+/* gain times the estimated bandwidth-delay product, plus a few segments
+ * for delayed and stretched ACKs.  with no estimate yet there's nothing to
+ * aim for.
+ */
+static uint32_t bbr_target_cwnd(const stcp_cc_t *cc, double gain)
+{
+    const cc_bbr_t *b = &cc->u.bbr;
+    double bdp;
+
+    if (!b->btl_bw || !b->min_rtt)
+        return BBR_MAX_CWND;
+
+    bdp = (double) b->btl_bw * b->min_rtt / 1000000.0;
+    bdp = gain * bdp + 3 * cc->mss;
+    if (bdp > BBR_MAX_CWND)
+        return BBR_MAX_CWND;
+    return MAX((uint32_t) bdp, BBR_MIN_CWND(cc->mss));
+}
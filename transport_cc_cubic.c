@@ -0,0 +1,180 @@
+/* transport_cc_cubic.c--CUBIC congestion control (RFC 8312).
+ *
+ * after a loss, the window grows along a cubic function of the time since
+ * the reduction: quickly at first, flattening out as it approaches the
+ * window at which the loss happened, then probing beyond it.  growth is
+ * independent of the RTT, which suits long fat paths better than Reno's
+ * one segment per round trip.  fast recovery itself is NewReno's.
+ */
+
+#include <assert.h>
+#include "mysock.h"
+#include "transport.h"
+#include "transport_cc.h"
+
+
+#define CUBIC_C     0.4     /* scaling constant (segments/s^3) */
+#define CUBIC_BETA  0.7     /* multiplicative decrease factor */
+
+
+static void cubic_on_ack(stcp_cc_t *cc, const stcp_cc_ack_t *ack);
+static void cubic_on_loss(stcp_cc_t *cc, uint32_t in_flight,
+                          uint32_t dupacks, tcp_seq recover, uint64_t now);
+static void cubic_on_timeout(stcp_cc_t *cc, uint32_t in_flight, uint64_t now);
+static void cubic_on_ecn(stcp_cc_t *cc, uint32_t in_flight, uint64_t now);
+static void cubic_reduce(stcp_cc_t *cc);
+static double cubic_root(double x);
+
+
+const stcp_cc_ops_t stcp_cc_cubic =
+{
+    "cubic",
+    NULL,
+    cubic_on_ack,
+    cubic_on_loss,
+    cubic_on_timeout,
+    cubic_on_ecn,
+    stcp_cc_get_cwnd,
+    stcp_cc_get_ssthresh,
+    NULL
+};
+
+
+static void cubic_on_ack(stcp_cc_t *cc, const stcp_cc_ack_t *ack)
+{
+    cc_cubic_t *c;
+    double t, offset, target, mss;
+
+    assert(cc && ack);
+    c = &cc->u.cubic;
+    mss = cc->mss;
+
+    if (stcp_cc_recovery_ack(cc, ack, TRUE))
+        return;
+
+    if (cc->cwnd < cc->ssthresh)
+    {
+        stcp_cc_grow(cc, ack);  /* slow start */
+        return;
+    }
+
+    if (!stcp_cc_cwnd_limited(cc, ack))
+        return;
+
+    if (!c->epoch_start)
+    {
+        /* first ACK in congestion avoidance since the last reduction */
+        c->epoch_start = ack->now;
+        if (cc->cwnd < c->w_max)
+        {
+            c->k = cubic_root((c->w_max - cc->cwnd) / mss / CUBIC_C);
+            c->origin = c->w_max;
+        }
+        else
+        {
+            c->k = 0;
+            c->origin = cc->cwnd;
+        }
+        c->w_est = cc->cwnd;
+        cc->bytes_acked = 0;
+    }
+
+    /* where the cubic curve will be one RTT from now */
+    t = (double) (ack->now - c->epoch_start + ack->srtt) / 1000000.0;
+    offset = t - c->k;
+    target = (CUBIC_C * offset * offset * offset) * mss + c->origin;
+    if (target > 1.5 * cc->cwnd)
+        target = 1.5 * cc->cwnd;
+
+    /* a Reno flow with the same loss rate would grow by
+     * 3(1 - beta)/(1 + beta) segments per RTT; never do worse than that.
+     */
+    c->w_est += 3.0 * (1.0 - CUBIC_BETA) / (1.0 + CUBIC_BETA) *
+                mss * ack->bytes_acked / cc->cwnd;
+    if (c->w_est > target)
+        target = c->w_est;
+
+    if (target > cc->cwnd)
+    {
+        double incr;
+
+        cc->bytes_acked += ack->bytes_acked;
+        incr = (target - cc->cwnd) * cc->bytes_acked / cc->cwnd;
+        if (incr >= 1.0)
+        {
+            cc->cwnd += (uint32_t) incr;
+            cc->bytes_acked = 0;
+        }
+    }
+}
+
+static void cubic_on_loss(stcp_cc_t *cc, uint32_t in_flight,
+                          uint32_t dupacks, tcp_seq recover, uint64_t now)
+{
+    assert(cc);
+
+    cubic_reduce(cc);
+    cc->cwnd = cc->ssthresh + dupacks * cc->mss;
+    cc->in_recovery = TRUE;
+    cc->recover = recover;
+}
+
+static void cubic_on_timeout(stcp_cc_t *cc, uint32_t in_flight, uint64_t now)
+{
+    assert(cc);
+
+    cubic_reduce(cc);
+    cc->cwnd = cc->mss;
+    cc->in_recovery = FALSE;
+}
+
+static void cubic_on_ecn(stcp_cc_t *cc, uint32_t in_flight, uint64_t now)
+{
+    assert(cc);
+
+    cubic_reduce(cc);
+    cc->cwnd = cc->ssthresh;
+}
+
+/* remember the window at which the loss happened and lower ssthresh.  with
+ * fast convergence, a flow that keeps losing below its previous maximum
+ * gives up a little more, releasing bandwidth to newer flows.
+ */
+static void cubic_reduce(stcp_cc_t *cc)
+{
+    cc_cubic_t *c = &cc->u.cubic;
+
+    if (cc->cwnd < c->w_last_max)
+    {
+        c->w_last_max = cc->cwnd;
+        c->w_max = (uint32_t) (cc->cwnd * (1.0 + CUBIC_BETA) / 2.0);
+    }
+    else
+    {
+        c->w_last_max = c->w_max = cc->cwnd;
+    }
+
+    cc->ssthresh = MAX((uint32_t) (cc->cwnd * CUBIC_BETA), 2 * cc->mss);
+    cc->bytes_acked = 0;
+    c->epoch_start = 0;
+}
+
+/* cube root by Newton's method, so as not to need libm */
+static double cubic_root(double x)
+{
+    double r = 1.0, prev;
+    int k;
+
+    if (x <= 0.0)
+        return 0.0;
+
+    for (k = 0; k < 100; ++k)
+    {
+        prev = r;
+        r = (2.0 * r + x / (r * r)) / 3.0;
+        if (r - prev < 1e-9 && prev - r < 1e-9)
+            break;
+    }
+
+    return r;
+}
@@ -0,0 +1,99 @@
+/* transport_cc_reno.c--Reno (RFC 5681) and NewReno (RFC 6582) congestion
+ * control.  the two differ only in how fast recovery treats a partial
+ * ACK: Reno leaves recovery on the first new ACK, while NewReno stays in
+ * recovery until all data outstanding at the time of the loss has been
+ * acknowledged.
+ */
+
+#include <assert.h>
+#include "mysock.h"
+#include "transport.h"
+#include "transport_cc.h"
+
+
+static void reno_on_ack(stcp_cc_t *cc, const stcp_cc_ack_t *ack);
+static void newreno_on_ack(stcp_cc_t *cc, const stcp_cc_ack_t *ack);
+static void reno_on_loss(stcp_cc_t *cc, uint32_t in_flight,
+                         uint32_t dupacks, tcp_seq recover, uint64_t now);
+static void reno_on_timeout(stcp_cc_t *cc, uint32_t in_flight, uint64_t now);
+static void reno_on_ecn(stcp_cc_t *cc, uint32_t in_flight, uint64_t now);
+
+
+const stcp_cc_ops_t stcp_cc_reno =
+{
+    "reno",
+    NULL,
+    reno_on_ack,
+    reno_on_loss,
+    reno_on_timeout,
+    reno_on_ecn,
+    stcp_cc_get_cwnd,
+    stcp_cc_get_ssthresh,
+    NULL
+};
+
+const stcp_cc_ops_t stcp_cc_newreno =
+{
+    "newreno",
+    NULL,
+    newreno_on_ack,
+    reno_on_loss,
+    reno_on_timeout,
+    reno_on_ecn,
+    stcp_cc_get_cwnd,
+    stcp_cc_get_ssthresh,
+    NULL
+};
+
+
+static void reno_on_ack(stcp_cc_t *cc, const stcp_cc_ack_t *ack)
+{
+    assert(cc && ack);
+
+    if (!stcp_cc_recovery_ack(cc, ack, FALSE))
+        stcp_cc_grow(cc, ack);
+}
+
+static void newreno_on_ack(stcp_cc_t *cc, const stcp_cc_ack_t *ack)
+{
+    assert(cc && ack);
+
+    if (!stcp_cc_recovery_ack(cc, ack, TRUE))
+        stcp_cc_grow(cc, ack);
+}
+
+/* halve the window, and inflate it by the duplicate ACKs (segments that
+ * have left the network) that triggered fast retransmit.
+ */
+static void reno_on_loss(stcp_cc_t *cc, uint32_t in_flight,
+                         uint32_t dupacks, tcp_seq recover, uint64_t now)
+{
+    assert(cc);
+
+    cc->ssthresh = MAX(in_flight / 2, 2 * cc->mss);
+    cc->cwnd = cc->ssthresh + dupacks * cc->mss;
+    cc->bytes_acked = 0;
+    cc->in_recovery = TRUE;
+    cc->recover = recover;
+}
+
+/* halve ssthresh, and slow start again from one segment */
+static void reno_on_timeout(stcp_cc_t *cc, uint32_t in_flight, uint64_t now)
+{
+    assert(cc);
+
+    cc->ssthresh = MAX(in_flight / 2, 2 * cc->mss);
+    cc->cwnd = cc->mss;
+    cc->bytes_acked = 0;
+    cc->in_recovery = FALSE;
+}
+
+/* halve the window, as for a loss, and carry on in congestion avoidance */
+static void reno_on_ecn(stcp_cc_t *cc, uint32_t in_flight, uint64_t now)
+{
+    assert(cc);
+
+    cc->ssthresh = MAX(in_flight / 2, 2 * cc->mss);
+    cc->cwnd = MIN(cc->cwnd, cc->ssthresh);
+    cc->bytes_acked = 0;
+}
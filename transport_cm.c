@@ -0,0 +1,182 @@
+/* transport_cm.c--the congestion manager.
+ *
+ * the aggregate window follows NewReno (RFC 5681) for n connections,
+ * whatever the members' own algorithms: slow start, with byte counting,
+ * up to ssthresh, then n segments per window acknowledged, less half a
+ * share for each congestion event.  each member runs in its own thread,
+ * so every group is looked after under one lock.
+ */
+
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+#include "mysock.h"
+#include "transport.h"
+#include "transport_cc.h"
+#include "transport_cm.h"
+
+
+struct stcp_cm_group
+{
+    struct stcp_cm_group *next;
+    uint32_t addr;
+    unsigned int members;
+
+    uint32_t mss;
+    uint32_t cwnd;          /* aggregate window (bytes) */
+    uint32_t ssthresh;
+    uint32_t bytes_acked;   /* acked bytes not yet credited in CA */
+
+    uint32_t srtt;          /* shared RTT estimate, 0 before any sample */
+    uint32_t rttvar;
+};
+
+/* the aggregate never grows beyond this */
+#define CM_MAX_CWND     (1U << 30)
+
+static stcp_cm_group_t *cm_groups;
+static pthread_mutex_t cm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+stcp_cm_group_t *stcp_cm_join(uint32_t addr, uint32_t mss)
+{
+    stcp_cm_group_t *g;
+
+    assert(mss > 0);
+
+    pthread_mutex_lock(&cm_lock);
+    for (g = cm_groups; g && g->addr != addr; g = g->next)
+        ;
+
+    if (!g)
+    {
+        g = (stcp_cm_group_t *) calloc(1, sizeof(*g));
+        assert(g);
+
+        g->addr = addr;
+        g->mss = mss;
+        g->ssthresh = CM_MAX_CWND;
+        g->next = cm_groups;
+        cm_groups = g;
+    }
+
+    g->cwnd = MIN(g->cwnd + STCP_CC_INITIAL_WINDOW(g->mss), CM_MAX_CWND);
+    ++g->members;
+    dprintf("congestion manager: %u connection(s) to %08x\n",
+            g->members, (unsigned int) addr);
+    pthread_mutex_unlock(&cm_lock);
+
+    return g;
+}
+
+void stcp_cm_leave(stcp_cm_group_t *g)
+{
+    stcp_cm_group_t **pg;
+
+    assert(g && g->members > 0);
+
+    pthread_mutex_lock(&cm_lock);
+    if (--g->members == 0)
+    {
+        for (pg = &cm_groups; *pg != g; pg = &(*pg)->next)
+            assert(*pg);
+        *pg = g->next;
+        free(g);
+    }
+    pthread_mutex_unlock(&cm_lock);
+}
+
+/* never less than two segments, so a member's ACKs aren't held up by
+ * delayed ACKs for want of a second segment
+ */
+uint32_t stcp_cm_share(stcp_cm_group_t *g)
+{
+    uint32_t share;
+
+    assert(g);
+
+    pthread_mutex_lock(&cm_lock);
+    share = MAX(g->cwnd / g->members, 2 * g->mss);
+    pthread_mutex_unlock(&cm_lock);
+
+    return share;
+}
+
+void stcp_cm_ack(stcp_cm_group_t *g, uint32_t bytes_acked,
+                 uint32_t in_flight)
+{
+    assert(g);
+
+    pthread_mutex_lock(&cm_lock);
+    if (in_flight + g->mss > MAX(g->cwnd / g->members, 2 * g->mss))
+    {
+        if (g->cwnd < g->ssthresh)
+        {
+            g->cwnd = MIN(g->cwnd + MIN(bytes_acked, 2 * g->mss),
+                          CM_MAX_CWND);
+        }
+        else
+        {
+            g->bytes_acked += bytes_acked;
+            if (g->bytes_acked >= g->cwnd / g->members)
+            {
+                g->bytes_acked -= g->cwnd / g->members;
+                g->cwnd = MIN(g->cwnd + g->mss, CM_MAX_CWND);
+            }
+        }
+    }
+    pthread_mutex_unlock(&cm_lock);
+}
+
+uint32_t stcp_cm_congestion(stcp_cm_group_t *g)
+{
+    uint32_t cwnd;
+
+    assert(g);
+
+    pthread_mutex_lock(&cm_lock);
+    cwnd = g->cwnd;
+    g->ssthresh = MAX(g->cwnd - g->cwnd / (2 * g->members),
+                      2 * g->mss * g->members);
+    g->cwnd = MIN(g->cwnd, g->ssthresh);
+    g->bytes_acked = 0;
+    cwnd -= g->cwnd;
+    pthread_mutex_unlock(&cm_lock);
+
+    return cwnd;
+}
+
+void stcp_cm_undo(stcp_cm_group_t *g, uint32_t cut)
+{
+    assert(g);
+
+    pthread_mutex_lock(&cm_lock);
+    g->cwnd = MIN(g->cwnd + cut, CM_MAX_CWND);
+    g->ssthresh = MAX(g->ssthresh, g->cwnd);
+    pthread_mutex_unlock(&cm_lock);
+}
+
+/* the usual smoothing (RFC 6298), over every member's samples */
+void stcp_cm_rtt_sample(stcp_cm_group_t *g, uint32_t sample,
+                        uint32_t *srtt, uint32_t *rttvar)
+{
+    assert(g && srtt && rttvar);
+
+    pthread_mutex_lock(&cm_lock);
+    if (!g->srtt)
+    {
+        g->srtt = MAX(sample, 1);
+        g->rttvar = sample / 2;
+    }
+    else
+    {
+        uint32_t delta = (sample > g->srtt)
+            ? sample - g->srtt : g->srtt - sample;
+
+        g->rttvar = (3 * g->rttvar + delta) / 4;
+        g->srtt = MAX((7 * g->srtt + sample) / 8, 1);
+    }
+    *srtt = g->srtt;
+    *rttvar = g->rttvar;
+    pthread_mutex_unlock(&cm_lock);
+}
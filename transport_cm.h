@@ -0,0 +1,63 @@
+/* transport_cm.h--congestion manager: congestion state shared by the
+ * connections to a host (MYSO_CONGESTION_MANAGER).
+ *
+ * connections to the same host cross the same bottleneck, so probing for
+ * bandwidth independently, each with a window of its own, just has them
+ * overrun it together and split what's left unevenly.  instead, those
+ * that opt in form a group with one aggregate window (RFC 3124), split
+ * evenly between them.  every member's ACKs grow it and every member's
+ * losses cut it, so the group is never more aggressive than the same
+ * number of separate connections would be, but slow start is shared,
+ * and a member that finishes leaves its share to the others instead of
+ * them having to probe for it.  each member's own congestion control
+ * still runs, for its recovery and retransmission timeouts, but it sends
+ * no more than its share.  the group also keeps one RTT estimate, fed by
+ * every member's samples.
+ */
+
+#ifndef __TRANSPORT_CM_H__
+#define __TRANSPORT_CM_H__
+
+#include "transport.h"
+
+
+typedef struct stcp_cm_group stcp_cm_group_t;
+
+
+/* join the group for the host at addr (an IPv4 address, in network byte
+ * order), starting one if there isn't one.  the aggregate window grows by
+ * an initial window for the new member, sized by mss.
+ */
+stcp_cm_group_t *stcp_cm_join(uint32_t addr, uint32_t mss);
+
+/* leave the group, leaving the share to the others; the last member out
+ * frees it
+ */
+void stcp_cm_leave(stcp_cm_group_t *g);
+
+/* a member's share of the aggregate window (bytes) */
+uint32_t stcp_cm_share(stcp_cm_group_t *g);
+
+/* a member had bytes_acked bytes of new data acknowledged, with in_flight
+ * bytes outstanding beforehand.  the aggregate only grows if the member
+ * was using its share.
+ */
+void stcp_cm_ack(stcp_cm_group_t *g, uint32_t bytes_acked,
+                 uint32_t in_flight);
+
+/* a member saw a loss or a congestion mark, and reduced its own window
+ * as it does once per window of data.  the aggregate loses half of one
+ * member's share; returns how much that was.
+ */
+uint32_t stcp_cm_congestion(stcp_cm_group_t *g);
+
+/* a member found its loss response needless: give back what was cut */
+void stcp_cm_undo(stcp_cm_group_t *g, uint32_t cut);
+
+/* feed a member's RTT sample into the group's estimate, and return the
+ * estimate in *srtt and *rttvar
+ */
+void stcp_cm_rtt_sample(stcp_cm_group_t *g, uint32_t sample,
+                        uint32_t *srtt, uint32_t *rttvar);
+
+#endif  /* __TRANSPORT_CM_H__ */
@@ -0,0 +1,96 @@
+/* transport_metrics.c--the per-host metrics cache.
+ *
+ * each connection runs in its own thread, so the cache is behind a lock.
+ * it's only used as connections open and close, so a linear search of a
+ * small table is plenty.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include "mysock.h"
+#include "transport.h"
+#include "transport_metrics.h"
+
+
+typedef struct
+{
+    bool_t   valid;
+    uint32_t addr;
+    uint64_t stored;        /* when the metrics were stored */
+    uint64_t used;          /* when last stored or looked up */
+    stcp_metrics_t m;
+} metrics_entry_t;
+
+static metrics_entry_t metrics_cache[METRICS_CACHE_SIZE];
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static metrics_entry_t *metrics_find(uint32_t addr);
+
+
+bool_t stcp_metrics_lookup(uint32_t addr, uint64_t now, stcp_metrics_t *m)
+{
+    metrics_entry_t *e;
+    bool_t found = FALSE;
+
+    assert(m);
+
+    pthread_mutex_lock(&metrics_lock);
+    if ((e = metrics_find(addr)) != NULL)
+    {
+        if (now - e->stored < METRICS_TIMEOUT)
+        {
+            *m = e->m;
+            e->used = now;
+            found = TRUE;
+        }
+        else
+        {
+            e->valid = FALSE;
+        }
+    }
+    pthread_mutex_unlock(&metrics_lock);
+
+    return found;
+}
+
+void stcp_metrics_store(uint32_t addr, uint64_t now, const stcp_metrics_t *m)
+{
+    metrics_entry_t *e;
+
+    assert(m);
+
+    pthread_mutex_lock(&metrics_lock);
+    if ((e = metrics_find(addr)) == NULL)
+    {
+        unsigned int k;
+
+        /* a free entry, or else the least recently used one */
+        e = &metrics_cache[0];
+        for (k = 0; k < METRICS_CACHE_SIZE && e->valid; ++k)
+        {
+            if (!metrics_cache[k].valid || metrics_cache[k].used < e->used)
+                e = &metrics_cache[k];
+        }
+    }
+
+    e->valid  = TRUE;
+    e->addr   = addr;
+    e->stored = e->used = now;
+    e->m      = *m;
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+
+/* the entry for addr, or NULL.  the caller holds metrics_lock. */
+static metrics_entry_t *metrics_find(uint32_t addr)
+{
+    unsigned int k;
+
+    for (k = 0; k < METRICS_CACHE_SIZE; ++k)
+    {
+        if (metrics_cache[k].valid && metrics_cache[k].addr == addr)
+            return &metrics_cache[k];
+    }
+    return NULL;
+}
@@ -0,0 +1,42 @@
+/* transport_metrics.h--what connections learn about the path to a host,
+ * kept for later connections to the same host.
+ *
+ * a closing connection leaves its RTT estimate and congestion window in a
+ * process-wide cache, keyed by the peer's address.  a new connection to
+ * that host starts its retransmission timer and congestion window from
+ * them, rather than from a cold start.  entries are forgotten once they're
+ * METRICS_TIMEOUT old, since the path may have changed by then, and the
+ * least recently used entry makes way when the cache is full.
+ */
+
+#ifndef __TRANSPORT_METRICS_H__
+#define __TRANSPORT_METRICS_H__
+
+#include "transport.h"
+
+
+#define METRICS_CACHE_SIZE  64
+#define METRICS_TIMEOUT     ((uint64_t) 10 * 60 * 1000000)  /* microseconds */
+
+typedef struct
+{
+    uint32_t srtt;          /* smoothed RTT (microseconds) */
+    uint32_t rttvar;        /* RTT mean deviation */
+    uint32_t ssthresh;      /* slow start threshold (bytes) */
+    uint32_t cwnd;          /* congestion window (bytes) */
+} stcp_metrics_t;
+
+
+/* find what was last stored for the host at addr (an IPv4 address, in
+ * network byte order), at time now.  returns FALSE, leaving m alone, if
+ * nothing was, or it's too old to trust.
+ */
+bool_t stcp_metrics_lookup(uint32_t addr, uint64_t now, stcp_metrics_t *m);
+
+/* store a closing connection's metrics for the host at addr, at time now,
+ * replacing whatever was there.  times are in microseconds on the
+ * monotonic clock.
+ */
+void stcp_metrics_store(uint32_t addr, uint64_t now, const stcp_metrics_t *m);
+
+#endif  /* __TRANSPORT_METRICS_H__ */
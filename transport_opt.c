@@ -0,0 +1,255 @@
+/* transport_opt.c--parsing and building of TCP options */
+
+#include <string.h>
+#include <assert.h>
+#include <arpa/inet.h>
+#include "mysock.h"
+#include "transport.h"
+#include "transport_opt.h"
+
+
+void stcp_opt_parse(const STCPHeader *hdr, stcp_opts_t *opts)
+{
+    const uint8_t *cp;
+    size_t len;
+
+    assert(hdr && opts);
+
+    memset(opts, 0, sizeof(*opts));
+    cp = (const uint8_t *) hdr + sizeof(STCPHeader);
+    len = TCP_OPTIONS_LEN(hdr);
+
+    while (len > 0)
+    {
+        uint8_t kind = cp[0], optlen;
+
+        if (kind == TCPOPT_EOL)
+            break;
+        if (kind == TCPOPT_NOP)
+        {
+            ++cp;
+            --len;
+            continue;
+        }
+
+        if (len < 2 || (optlen = cp[1]) < 2 || optlen > len)
+            break;
+
+        switch (kind)
+        {
+        case TCPOPT_MAXSEG:
+            if (optlen == TCPOLEN_MAXSEG && (hdr->th_flags & TH_SYN))
+                opts->mss = (cp[2] << 8) | cp[3];
+            break;
+
+        case TCPOPT_WINDOW:
+            if (optlen == TCPOLEN_WINDOW && (hdr->th_flags & TH_SYN))
+            {
+                opts->wscale_present = TRUE;
+                opts->wscale = MIN(cp[2], TCP_MAX_WINSHIFT);
+            }
+            break;
+
+        case TCPOPT_TIMESTAMP:
+            if (optlen == TCPOLEN_TIMESTAMP)
+            {
+                uint32_t val;
+
+                opts->ts_present = TRUE;
+                memcpy(&val, cp + 2, sizeof(val));
+                opts->ts_val = ntohl(val);
+                memcpy(&val, cp + 2 + sizeof(val), sizeof(val));
+                opts->ts_ecr = ntohl(val);
+
+                /* the echo only means something on a segment with ACK
+                 * set (RFC 7323, section 3.2); a SYN has nothing to echo
+                 * yet.  zero is an ordinary clock value, so can't tell.
+                 */
+                opts->ts_ecr_valid = (hdr->th_flags & TH_ACK) != 0;
+            }
+            break;
+
+        case TCPOPT_SACK_PERMITTED:
+            if (optlen == TCPOLEN_SACK_PERMITTED && (hdr->th_flags & TH_SYN))
+                opts->sack_permitted = TRUE;
+            break;
+
+        case TCPOPT_FEC_PERMITTED:
+            if (optlen == TCPOLEN_FEC_PERMITTED && (hdr->th_flags & TH_SYN))
+                opts->fec_permitted = TRUE;
+            break;
+
+        case TCPOPT_FEC:
+            if (optlen == TCPOLEN_FEC && !(hdr->th_flags & TH_SYN))
+            {
+                uint32_t end;
+
+                opts->fec_present = TRUE;
+                memcpy(&end, cp + 2, sizeof(end));
+                opts->fec_end = ntohl(end);
+            }
+            break;
+
+        case TCPOPT_SACK:
+            if ((optlen - 2) % TCPOLEN_SACK_BLOCK == 0)
+            {
+                const uint8_t *bp = cp + 2;
+                unsigned int k, n = (optlen - 2) / TCPOLEN_SACK_BLOCK;
+                uint32_t start, end;
+
+                for (k = 0; k < n && opts->num_sack < MAX_SACK_BLOCKS; ++k)
+                {
+                    memcpy(&start, bp, sizeof(start));
+                    memcpy(&end, bp + sizeof(start), sizeof(end));
+                    bp += TCPOLEN_SACK_BLOCK;
+
+                    opts->sack[opts->num_sack].start = ntohl(start);
+                    opts->sack[opts->num_sack].end = ntohl(end);
+                    if (SEQ_LT(opts->sack[opts->num_sack].start,
+                               opts->sack[opts->num_sack].end))
+                    {
+                        ++opts->num_sack;
+                    }
+                }
+            }
+            break;
+
+        default:
+            break;  /* not one of ours */
+        }
+
+        cp += optlen;
+        len -= optlen;
+    }
+}
+
+bool_t stcp_opt_parse_fast(const STCPHeader *hdr, stcp_opts_t *opts)
+{
+    const uint8_t *cp;
+    uint32_t word;
+
+    assert(hdr && opts);
+
+    memset(opts, 0, sizeof(*opts));
+    if (TCP_OPTIONS_LEN(hdr) == 0)
+        return TRUE;
+    if (TCP_OPTIONS_LEN(hdr) != TCPOLEN_TIMESTAMP_APPA)
+        return FALSE;
+
+    cp = (const uint8_t *) hdr + sizeof(STCPHeader);
+    memcpy(&word, cp, sizeof(word));
+    if (word != htonl((TCPOPT_NOP << 24) | (TCPOPT_NOP << 16) |
+                      (TCPOPT_TIMESTAMP << 8) | TCPOLEN_TIMESTAMP))
+    {
+        return FALSE;
+    }
+
+    opts->ts_present = TRUE;
+    memcpy(&word, cp + sizeof(word), sizeof(word));
+    opts->ts_val = ntohl(word);
+    memcpy(&word, cp + 2 * sizeof(word), sizeof(word));
+    opts->ts_ecr = ntohl(word);
+    opts->ts_ecr_valid = (hdr->th_flags & TH_ACK) != 0;
+    return TRUE;
+}
+
+size_t stcp_opt_build(char *buf, size_t max_len, const stcp_opts_t *opts)
+{
+    uint8_t *cp = (uint8_t *) buf;
+    size_t len = 0;
+
+    assert(buf && opts);
+    assert(max_len <= MAX_TCP_OPTIONS_LEN);
+    assert(opts->wscale <= TCP_MAX_WINSHIFT);
+
+    if (opts->mss)
+    {
+        cp[len++] = TCPOPT_MAXSEG;
+        cp[len++] = TCPOLEN_MAXSEG;
+        cp[len++] = opts->mss >> 8;
+        cp[len++] = opts->mss & 0xff;
+    }
+
+    /* the timestamp goes first, so that it's never crowded out by SACK
+     * blocks
+     */
+    if (opts->ts_present)
+    {
+        uint32_t val;
+
+        cp[len++] = TCPOPT_NOP;
+        cp[len++] = TCPOPT_NOP;
+        cp[len++] = TCPOPT_TIMESTAMP;
+        cp[len++] = TCPOLEN_TIMESTAMP;
+        val = htonl(opts->ts_val);
+        memcpy(cp + len, &val, sizeof(val));
+        val = htonl(opts->ts_ecr);
+        memcpy(cp + len + sizeof(val), &val, sizeof(val));
+        len += 2 * sizeof(val);
+    }
+
+    if (opts->wscale_present)
+    {
+        cp[len++] = TCPOPT_NOP;
+        cp[len++] = TCPOPT_WINDOW;
+        cp[len++] = TCPOLEN_WINDOW;
+        cp[len++] = opts->wscale;
+    }
+
+    if (opts->sack_permitted)
+    {
+        cp[len++] = TCPOPT_NOP;
+        cp[len++] = TCPOPT_NOP;
+        cp[len++] = TCPOPT_SACK_PERMITTED;
+        cp[len++] = TCPOLEN_SACK_PERMITTED;
+    }
+
+    if (opts->fec_permitted)
+    {
+        cp[len++] = TCPOPT_NOP;
+        cp[len++] = TCPOPT_NOP;
+        cp[len++] = TCPOPT_FEC_PERMITTED;
+        cp[len++] = TCPOLEN_FEC_PERMITTED;
+    }
+
+    if (opts->fec_present)
+    {
+        uint32_t end = htonl(opts->fec_end);
+
+        cp[len++] = TCPOPT_NOP;
+        cp[len++] = TCPOPT_NOP;
+        cp[len++] = TCPOPT_FEC;
+        cp[len++] = TCPOLEN_FEC;
+        memcpy(cp + len, &end, sizeof(end));
+        len += sizeof(end);
+    }
+
+    if (opts->num_sack > 0 && len + 4 + TCPOLEN_SACK_BLOCK <= max_len)
+    {
+        unsigned int k, n;
+        uint32_t start, end;
+
+        n = MIN(opts->num_sack, (max_len - len - 4) / TCPOLEN_SACK_BLOCK);
+
+        cp[len++] = TCPOPT_NOP;
+        cp[len++] = TCPOPT_NOP;
+        cp[len++] = TCPOPT_SACK;
+        cp[len++] = 2 + n * TCPOLEN_SACK_BLOCK;
+
+        for (k = 0; k < n; ++k)
+        {
+            start = htonl(opts->sack[k].start);
+            end = htonl(opts->sack[k].end);
+            memcpy(cp + len, &start, sizeof(start));
+            memcpy(cp + len + sizeof(start), &end, sizeof(end));
+            len += TCPOLEN_SACK_BLOCK;
+        }
+    }
+
+    /* pad out to a whole number of words */
+    while (len % sizeof(uint32_t))
+        cp[len++] = TCPOPT_EOL;
+
+    assert(len <= max_len);
+    return len;
+}
@@ -0,0 +1,101 @@
+/* transport_opt.h--TCP options carried in STCP headers.
+ *
+ * options are parsed from an incoming segment into an stcp_opts_t, and
+ * built from one into the option space of an outgoing segment.  only the
+ * options STCP understands are represented; anything else is skipped.
+ */
+
+#ifndef __TRANSPORT_OPT_H__
+#define __TRANSPORT_OPT_H__
+
+#include "transport.h"
+
+
+/* option kinds and lengths (RFC 793, RFC 2018, RFC 7323) */
+#define TCPOPT_EOL              0
+#define TCPOPT_NOP              1
+#define TCPOPT_MAXSEG           2
+#define TCPOPT_WINDOW           3
+#define TCPOPT_SACK_PERMITTED   4
+#define TCPOPT_SACK             5
+#define TCPOPT_TIMESTAMP        8
+
+/* STCP's own forward error correction, on the experimental kinds (RFC
+ * 4727).  a SYN says the sender can rebuild lost data from parity
+ * segments; a parity segment gives the end of the sequence space it
+ * covers (th_seq gives the start).
+ */
+#define TCPOPT_FEC_PERMITTED    253
+#define TCPOPT_FEC              254
+
+#define TCPOLEN_MAXSEG          4
+#define TCPOLEN_WINDOW          3
+#define TCPOLEN_SACK_PERMITTED  2
+#define TCPOLEN_SACK_BLOCK      8   /* per block, after the kind and length */
+#define TCPOLEN_TIMESTAMP       10
+#define TCPOLEN_TIMESTAMP_APPA  (TCPOLEN_TIMESTAMP + 2)     /* padded */
+#define TCPOLEN_FEC_PERMITTED   2
+#define TCPOLEN_FEC             6
+#define TCPOLEN_FEC_APPA        (TCPOLEN_FEC + 2)           /* padded */
+
+/* largest window scale shift allowed (RFC 7323, section 2.3) */
+#define TCP_MAX_WINSHIFT        14
+
+/* most option bytes a header can carry (th_off is four bits) */
+#define MAX_TCP_OPTIONS_LEN     (15 * sizeof(uint32_t) - sizeof(STCPHeader))
+
+/* most SACK blocks that fit in the option space (three, alongside a
+ * timestamp)
+ */
+#define MAX_SACK_BLOCKS         4
+
+
+/* a block of contiguous sequence space, [start, end) */
+typedef struct
+{
+    tcp_seq start;
+    tcp_seq end;
+} stcp_sack_block_t;
+
+typedef struct
+{
+    uint16_t mss;               /* SYN only: largest segment taken, or 0 */
+    bool_t sack_permitted;      /* SYN only: sender can receive SACKs */
+    bool_t fec_permitted;       /* SYN only: sender can receive parity */
+    bool_t wscale_present;      /* SYN only: sender scales its window... */
+    unsigned int wscale;        /* ...by this shift */
+
+    bool_t ts_present;          /* timestamp option present... */
+    uint32_t ts_val;            /* ...with the sender's clock */
+    uint32_t ts_ecr;            /* ...and the latest one it's seen of ours */
+    bool_t ts_ecr_valid;        /* ...which only counts on an ACK */
+
+    bool_t fec_present;         /* this is a parity segment... */
+    tcp_seq fec_end;            /* ...covering up to here */
+
+    unsigned int num_sack;      /* SACK blocks present, most recent first */
+    stcp_sack_block_t sack[MAX_SACK_BLOCKS];
+} stcp_opts_t;
+
+
+/* parse the options in a segment whose header (including th_off) has
+ * already been validated.  malformed options end parsing early; the
+ * segment itself is still usable.
+ */
+void stcp_opt_parse(const STCPHeader *hdr, stcp_opts_t *opts);
+
+/* parse the options in a segment if they're what nearly every segment
+ * on an established connection carries: none, or only a timestamp, laid
+ * out as stcp_opt_build() writes it (RFC 7323, appendix A).  returns
+ * FALSE for anything else, leaving the caller to use stcp_opt_parse().
+ */
+bool_t stcp_opt_parse_fast(const STCPHeader *hdr, stcp_opts_t *opts);
+
+/* write the options in opts into buf, padded to a multiple of four bytes,
+ * using no more than max_len (at most MAX_TCP_OPTIONS_LEN) bytes.  SACK
+ * blocks that don't fit after the other options are left out.  returns
+ * the number of bytes written.
+ */
+size_t stcp_opt_build(char *buf, size_t max_len, const stcp_opts_t *opts);
+
+#endif  /* __TRANSPORT_OPT_H__ */
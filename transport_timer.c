@@ -0,0 +1,231 @@
+/* transport_timer.c--hierarchical timing wheel for the transport layer's
+ * timers.
+ *
+ * a timer lives in one slot of one level.  on the first level, the slot
+ * is the one for its expiry tick.  on upper levels, it's the slot for the
+ * block of ticks its expiry falls in; when the wheel reaches the start of
+ * that block, the slot is emptied and its timers placed again, now on a
+ * lower level.  so any timer is moved at most TIMER_LEVELS - 1 times.
+ */
+
+#include <string.h>
+#include <assert.h>
+#include "mysock.h"
+#include "transport.h"
+#include "transport_timer.h"
+
+
+#define SLOT_MASK           (TIMER_SLOTS - 1)
+#define LEVEL_SHIFT(level)  ((level) * TIMER_LEVEL_BITS)
+
+/* ticks covered by the whole wheel */
+#define WHEEL_SPAN          ((uint64_t) 1 << LEVEL_SHIFT(TIMER_LEVELS))
+
+
+static void timer_place(stcp_timer_wheel_t *w, stcp_timer_t *t);
+static void timer_unlink(stcp_timer_t *t);
+static void timer_cascade(stcp_timer_wheel_t *w, unsigned int level);
+static uint32_t timer_expire_slot(stcp_timer_wheel_t *w, stcp_timer_t **slot,
+                                  uint64_t limit);
+
+
+void stcp_timer_wheel_init(stcp_timer_wheel_t *w, uint64_t now)
+{
+    assert(w);
+
+    memset(w, 0, sizeof(*w));
+    w->tick = now / TIMER_TICK;
+}
+
+void stcp_timer_init(stcp_timer_t *t, unsigned int id)
+{
+    assert(t && id < 32);
+
+    memset(t, 0, sizeof(*t));
+    t->id = id;
+}
+
+void stcp_timer_arm(stcp_timer_wheel_t *w, stcp_timer_t *t, uint64_t expires)
+{
+    assert(w && t);
+
+    if (stcp_timer_pending(t))
+        timer_unlink(t);
+    else
+        ++w->armed;
+
+    t->expires = expires;
+    timer_place(w, t);
+}
+
+void stcp_timer_cancel(stcp_timer_wheel_t *w, stcp_timer_t *t)
+{
+    assert(w && t);
+
+    if (stcp_timer_pending(t))
+    {
+        timer_unlink(t);
+        assert(w->armed > 0);
+        --w->armed;
+    }
+}
+
+uint32_t stcp_timer_advance(stcp_timer_wheel_t *w, uint64_t now)
+{
+    uint64_t tick = now / TIMER_TICK;
+    uint32_t expired = 0;
+
+    assert(w);
+
+    if (!w->armed)
+    {
+        w->tick = MAX(w->tick, tick);
+        return 0;
+    }
+
+    /* every timer in a first-level slot expires during its tick, so a
+     * tick that's over takes its whole slot with it
+     */
+    while (w->tick < tick)
+    {
+        unsigned int level;
+
+        expired |= timer_expire_slot(w, &w->slots[0][w->tick & SLOT_MASK],
+                                     (uint64_t) -1);
+        ++w->tick;
+
+        for (level = 1; level < TIMER_LEVELS; ++level)
+        {
+            if (w->tick & (((uint64_t) 1 << LEVEL_SHIFT(level)) - 1))
+                break;
+            timer_cascade(w, level);
+        }
+    }
+
+    return expired | timer_expire_slot(w, &w->slots[0][w->tick & SLOT_MASK],
+                                       now);
+}
+
+uint64_t stcp_timer_next(const stcp_timer_wheel_t *w)
+{
+    uint64_t next = (uint64_t) -1;
+    unsigned int level, k;
+
+    assert(w);
+
+    if (!w->armed)
+        return 0;
+
+    /* the first occupied slot on the first level has the nearest expiry
+     * on that level...
+     */
+    for (k = 0; k < TIMER_SLOTS; ++k)
+    {
+        const stcp_timer_t *t = w->slots[0][(w->tick + k) & SLOT_MASK];
+
+        if (t)
+        {
+            for (; t; t = t->next)
+                next = MIN(next, t->expires);
+            break;
+        }
+    }
+
+    /* ...but a timer on an upper level may need moving down before then */
+    for (level = 1; level < TIMER_LEVELS; ++level)
+    {
+        for (k = 1; k <= TIMER_SLOTS; ++k)
+        {
+            uint64_t block = (w->tick >> LEVEL_SHIFT(level)) + k;
+
+            if (w->slots[level][block & SLOT_MASK])
+            {
+                next = MIN(next, (block << LEVEL_SHIFT(level)) * TIMER_TICK);
+                break;
+            }
+        }
+    }
+
+    return next;
+}
+
+
+/* put an armed timer in the slot for its expiry */
+static void timer_place(stcp_timer_wheel_t *w, stcp_timer_t *t)
+{
+    uint64_t tick = t->expires / TIMER_TICK, delta;
+    unsigned int level = 0;
+    stcp_timer_t **slot;
+
+    assert(w && t);
+
+    tick = MAX(tick, w->tick);  /* overdue; expire on the next advance */
+    delta = tick - w->tick;
+    while (level < TIMER_LEVELS - 1 &&
+           delta >= ((uint64_t) 1 << LEVEL_SHIFT(level + 1)))
+    {
+        ++level;
+    }
+    if (delta >= WHEEL_SPAN)
+        tick = w->tick + WHEEL_SPAN - 1;    /* wait at the far end */
+
+    slot = &w->slots[level][(tick >> LEVEL_SHIFT(level)) & SLOT_MASK];
+    t->next = *slot;
+    if (t->next)
+        t->next->pprev = &t->next;
+    *slot = t;
+    t->pprev = slot;
+}
+
+static void timer_unlink(stcp_timer_t *t)
+{
+    assert(t && t->pprev);
+
+    *t->pprev = t->next;
+    if (t->next)
+        t->next->pprev = t->pprev;
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+/* the wheel has reached the start of the block covered by this level's
+ * current slot; move its timers down
+ */
+static void timer_cascade(stcp_timer_wheel_t *w, unsigned int level)
+{
+    stcp_timer_t **slot, *t;
+
+    assert(w && level > 0 && level < TIMER_LEVELS);
+
+    slot = &w->slots[level][(w->tick >> LEVEL_SHIFT(level)) & SLOT_MASK];
+    while ((t = *slot) != NULL)
+    {
+        timer_unlink(t);
+        timer_place(w, t);
+    }
+}
+
+/* disarm the timers in a first-level slot that expire by limit, and
+ * return their bits
+ */
+static uint32_t timer_expire_slot(stcp_timer_wheel_t *w, stcp_timer_t **slot,
+                                  uint64_t limit)
+{
+    stcp_timer_t *t, *next;
+    uint32_t expired = 0;
+
+    assert(w && slot);
+
+    for (t = *slot; t; t = next)
+    {
+        next = t->next;
+        if (t->expires <= limit)
+        {
+            timer_unlink(t);
+            --w->armed;
+            expired |= 1U << t->id;
+        }
+    }
+
+    return expired;
+}
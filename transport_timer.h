@@ -0,0 +1,71 @@
+/* transport_timer.h--timers for the transport layer.
+ *
+ * each connection keeps its timers (retransmission, delayed ACK, etc.) in
+ * a hierarchical timing wheel.  arming and cancelling a timer are O(1);
+ * the wheel is advanced to the current time on each pass of the control
+ * loop, which then sleeps until the nearest expiry.  times are in
+ * microseconds on the monotonic clock.
+ */
+
+#ifndef __TRANSPORT_TIMER_H__
+#define __TRANSPORT_TIMER_H__
+
+#include "transport.h"
+
+
+/* the wheel has TIMER_LEVELS levels of TIMER_SLOTS slots.  a slot on the
+ * first level covers one tick, and each level's slots cover as much as
+ * the whole of the level below, so the wheel spans 64^4 ticks (about 4.6
+ * hours); timers further out than that wait on the last level.
+ */
+#define TIMER_TICK          1000    /* microseconds */
+#define TIMER_LEVEL_BITS    6
+#define TIMER_SLOTS         (1 << TIMER_LEVEL_BITS)
+#define TIMER_LEVELS        4
+
+typedef struct stcp_timer
+{
+    struct stcp_timer *next;    /* in its slot's list, while armed... */
+    struct stcp_timer **pprev;  /* ...or NULL if not armed */
+    uint64_t expires;           /* absolute expiry time */
+    unsigned int id;            /* bit reported by stcp_timer_advance() */
+} stcp_timer_t;
+
+typedef struct
+{
+    uint64_t tick;              /* the tick the wheel has reached */
+    unsigned int armed;         /* number of timers armed */
+    stcp_timer_t *slots[TIMER_LEVELS][TIMER_SLOTS];
+} stcp_timer_wheel_t;
+
+
+/* set up an empty wheel, starting at time now */
+void stcp_timer_wheel_init(stcp_timer_wheel_t *w, uint64_t now);
+
+/* set up a timer, initially not armed.  id (less than 32) identifies it
+ * in the mask returned by stcp_timer_advance().
+ */
+void stcp_timer_init(stcp_timer_t *t, unsigned int id);
+
+/* arm a timer to expire at the given time, replacing any earlier expiry.
+ * a time already past expires on the next stcp_timer_advance().
+ */
+void stcp_timer_arm(stcp_timer_wheel_t *w, stcp_timer_t *t, uint64_t expires);
+
+/* disarm a timer; this does nothing if it isn't armed */
+void stcp_timer_cancel(stcp_timer_wheel_t *w, stcp_timer_t *t);
+
+#define stcp_timer_pending(t)   ((t)->pprev != NULL)
+
+/* move the wheel on to time now, disarming every timer that has expired
+ * by then.  returns a mask with bit (1 << id) set for each of them.
+ */
+uint32_t stcp_timer_advance(stcp_timer_wheel_t *w, uint64_t now);
+
+/* returns the time by which stcp_timer_advance() next needs calling, or
+ * 0 if no timers are armed.  this is the nearest expiry, or sooner if a
+ * timer on an upper level is due to move down.
+ */
+uint64_t stcp_timer_next(const stcp_timer_wheel_t *w);
+
+#endif  /* __TRANSPORT_TIMER_H__ */